@@ -0,0 +1,55 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+/*
+ * 基准测试的结果输出
+ * 每个基准测试照常打印表格；命令行带 --json 时不打印表格，结束时输出一行 JSON：
+ *   {"bench":"buffer","results":[{"name":"append/16B","value":12.3,"unit":"ns/op"}, ...]}
+ * 不同提交的结果可以直接 diff 或者用脚本对比。--json 会从 argv 中去掉，不影响其他参数的位置。
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+class BenchReport {
+public:
+    BenchReport(const char* bench, int& argc, char* argv[]) : bench_(bench), json_(false) {
+        int n = 1;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--json") == 0) json_ = true;
+            else argv[n++] = argv[i];
+        }
+        argc = n;
+    }
+
+    ~BenchReport() {
+        if (!json_) return;
+        printf("{\"bench\":\"%s\",\"results\":[", bench_.c_str());
+        for (size_t i = 0; i < results_.size(); i++) {
+            printf("%s{\"name\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}", i ? "," : "",
+                   results_[i].name.c_str(), results_[i].value, results_[i].unit.c_str());
+        }
+        printf("]}\n");
+    }
+
+    bool Json() const { return json_; }     // 为 true 时调用者不要打印表格
+
+    void Add(const std::string& name, double value, const char* unit) {
+        results_.push_back({name, value, unit});
+    }
+
+private:
+    struct Result {
+        std::string name;
+        double value;
+        std::string unit;
+    };
+
+    std::string bench_;
+    bool json_;
+    std::vector<Result> results_;
+};
+
+#endif // BENCH_REPORT_H
@@ -0,0 +1,67 @@
+/*
+ * BlockQueue 的基准测试
+ * P 个生产者各 push_back 一批整数，C 个消费者 pop，测量全部取完的吞吐（每秒元素数）。
+ * 容量 1024 时主要是锁竞争，容量 16 时生产者和消费者还要频繁地在条件变量上互相等待。
+ * 用法：./bin/blockqueue_bench [每个生产者的元素数] [--json]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../code/log/BlockQueue.h"
+#include "BenchReport.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+// 返回每秒元素数，每个消费者取到 -1 时退出
+static double Run(int producers, int consumers, size_t capacity, int perProducer) {
+    BlockQueue<int> queue(capacity);
+    std::vector<std::thread> threads;
+    std::vector<long> sums(consumers, 0);
+    auto start = BenchClock::now();
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&queue, &sums, c] {
+            int item = 0;
+            long sum = 0;
+            while (queue.pop(item) && item >= 0) sum += item;
+            sums[c] = sum;
+        });
+    }
+    std::vector<std::thread> pushers;
+    for (int p = 0; p < producers; p++) {
+        pushers.emplace_back([&queue, perProducer] {
+            for (int i = 0; i < perProducer; i++) queue.push_back(i);
+        });
+    }
+    for (auto& t : pushers) t.join();
+    for (int c = 0; c < consumers; c++) queue.push_back(-1);
+    for (auto& t : threads) t.join();
+    std::chrono::duration<double> sec = BenchClock::now() - start;
+
+    long sum = 0;
+    for (long s : sums) sum += s;
+    long expect = static_cast<long>(producers) * perProducer * (perProducer - 1) / 2;
+    if (sum != expect) fprintf(stderr, "  warning: sum %ld != %ld\n", sum, expect);
+    return static_cast<double>(producers) * perProducer / sec.count();
+}
+
+int main(int argc, char* argv[]) {
+    BenchReport report("blockqueue", argc, argv);
+    int perProducer = argc > 1 ? atoi(argv[1]) : 200000;
+
+    const int SHAPES[][2] = {{1, 1}, {2, 2}, {4, 1}, {4, 4}, {8, 8}};
+    const size_t CAPACITIES[] = {1024, 16};
+    if (!report.Json()) printf("%10s %10s %10s %14s %10s\n", "producers", "consumers", "capacity", "items/s", "ns/item");
+    for (size_t cap : CAPACITIES) {
+        for (const auto& shape : SHAPES) {
+            double rate = Run(shape[0], shape[1], cap, perProducer);
+            if (!report.Json()) printf("%10d %10d %10zu %14.0f %10.1f\n", shape[0], shape[1], cap, rate, 1e9 / rate);
+            report.Add(std::to_string(shape[0]) + "p" + std::to_string(shape[1]) + "c/cap" + std::to_string(cap),
+                       1e9 / rate, "ns/item");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Buffer 的基准测试
+ *   append/N      追加 N 字节再读走，缓冲区不扩容，测拷贝和下标维护的开销
+ *   grow/64KB     新建缓冲区后按 512 字节一块追加到 64KB，测 MakeSpace_ 换更大存储的开销
+ *   compact/N     读走大部分数据后再追加，剩下 N 字节要搬到开头（MakeSpace_ 的搬移分支）
+ *   readfd/N      从预先写满的管道里 ReadFd，每次管道里有 N 字节，只计 ReadFd 本身的时间
+ * 用法：./bin/buffer_bench [迭代次数] [--json]
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../code/buffer/Buffer.h"
+#include "BenchReport.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double NsSince(BenchClock::time_point start) {
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+}
+
+static double BenchAppend(size_t len, int iters) {
+    std::string data(len, 'x');
+    Buffer buff;
+    buff.EnsureWritable(len);
+    auto start = BenchClock::now();
+    for (int i = 0; i < iters; i++) {
+        buff.Append(data);
+        buff.Retrieve(buff.ReadableBytes());
+    }
+    return NsSince(start) / iters;
+}
+
+static double BenchGrow(int iters) {
+    char chunk[512] = {};
+    auto start = BenchClock::now();
+    for (int i = 0; i < iters; i++) {
+        Buffer buff;
+        for (int j = 0; j < 128; j++) buff.Append(chunk, sizeof(chunk));
+    }
+    return NsSince(start) / iters;
+}
+
+// 容量 4KB：追加 3KB，读走 3KB - keep，再追加 3KB 时放不下，把剩下的 keep 字节搬到开头
+static double BenchCompact(size_t keep, int iters) {
+    std::string data(3072, 'x');
+    Buffer buff(4096);
+    buff.EnsureWritable(4096);
+    auto start = BenchClock::now();
+    for (int i = 0; i < iters; i++) {
+        buff.Append(data);
+        buff.Retrieve(buff.ReadableBytes() - keep);
+        buff.Append(data);
+        buff.Retrieve(buff.ReadableBytes());
+    }
+    return NsSince(start) / iters;
+}
+
+static double BenchReadFd(size_t len, int iters) {
+    int fds[2];
+    if (pipe(fds) < 0) return 0;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETPIPE_SZ, 1 << 20);
+    std::string data(len, 'x');
+    Buffer buff;
+    double ns = 0;
+    int err = 0;
+    for (int i = 0; i < iters; i++) {
+        if (write(fds[1], data.data(), len) != static_cast<ssize_t>(len)) break;
+        auto start = BenchClock::now();
+        buff.ReadFd(fds[0], &err);
+        ns += NsSince(start);
+        buff.RetrieveAll();
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return ns / iters;
+}
+
+int main(int argc, char* argv[]) {
+    BenchReport report("buffer", argc, argv);
+    int iters = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    struct Case {
+        std::string name;
+        double ns;
+        size_t bytes;       // 每次操作处理的字节数，用来算带宽
+    };
+    std::vector<Case> cases;
+    const size_t APPEND_SIZES[] = {16, 256, 4096, 65536};
+    for (size_t len : APPEND_SIZES) {
+        int n = len >= 65536 ? iters / 50 : iters;
+        cases.push_back({"append/" + std::to_string(len) + "B", BenchAppend(len, n > 0 ? n : 1), len});
+    }
+    cases.push_back({"grow/64KB", BenchGrow(iters / 100 > 0 ? iters / 100 : 1), 65536});
+    const size_t KEEP_SIZES[] = {64, 1024};
+    for (size_t keep : KEEP_SIZES) {
+        cases.push_back({"compact/" + std::to_string(keep) + "B", BenchCompact(keep, iters), keep});
+    }
+    const size_t READ_SIZES[] = {512, 4096, 65536};
+    for (size_t len : READ_SIZES) {
+        int n = iters / 10 > 0 ? iters / 10 : 1;
+        cases.push_back({"readfd/" + std::to_string(len) + "B", BenchReadFd(len, n), len});
+    }
+
+    if (!report.Json()) printf("%-16s %12s %12s\n", "case", "ns/op", "MB/s");
+    for (const auto& c : cases) {
+        double mbps = c.ns > 0 ? c.bytes / c.ns * 1e9 / (1 << 20) : 0;
+        if (!report.Json()) printf("%-16s %12.1f %12.0f\n", c.name.c_str(), c.ns, mbps);
+        report.Add(c.name, c.ns, "ns/op");
+    }
+    return 0;
+}
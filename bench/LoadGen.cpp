@@ -0,0 +1,521 @@
+/*
+ * 基于 epoll 的压测工具，代替 webbench
+ * webbench 每个客户端 fork 一个进程、每个请求新建连接，只统计每秒页面数；这里每个线程一个 epoll，
+ * 非阻塞地驱动一组连接，支持长连接、流水线和按权重混合的请求，统计吞吐和延迟分位数。
+ *   - 延迟是从请求写出到完整收到响应（按 Content-length 判断）的时间，不含建立连接；
+ *   - 闭环压测：每个连接最多 depth 个请求在途，服务器变慢时发出的请求也会变少；
+ *   - 预热期间的请求不计入结果；
+ *   - 连接出错、超时或者服务器关闭连接后自动重连，在途的请求计为错误。
+ *
+ * 请求组合 -m 用逗号分隔的 名称:权重，名称可以是下面的预设，也可以直接写以 / 开头的路径（GET）：
+ *   index    GET /index.html          picture  GET /picture.html
+ *   image    GET /images/profile-image.jpg
+ *   css      GET /css/style.css       notfound GET /nope.html
+ *   login    POST /login.html，用户名密码由 -u/-s 指定（服务器连的应是测试库）
+ *
+ * 用法：./bin/loadgen [-a 地址] [-p 端口] [-c 连接数] [-t 线程数] [-d 秒数] [-w 预热秒数]
+ *                    [-P 流水线深度] [-K] [-m 请求组合] [-u 用户名] [-s 密码] [-T 超时毫秒] [-j]
+ *   -K 不用长连接，每个请求一个连接（和 webbench 一样）
+ *   -j 结果输出为一行 JSON，方便脚本比较
+ * 有传输错误或者没有一个成功的请求时退出码为 1。
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock BenchClock;
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count();
+}
+
+struct Options {
+    std::string addr = "127.0.0.1";
+    int port = 9006;
+    int conns = 64;
+    int threads = 4;
+    int duration = 10;
+    int warmup = 1;
+    int depth = 1;
+    bool keepAlive = true;
+    std::string mix = "index:1";
+    std::string user = "name";
+    std::string pwd = "password";
+    int timeoutMs = 5000;
+    bool json = false;
+};
+
+// 一种请求：预先拼好的报文和权重
+struct RequestKind {
+    std::string name;
+    std::string raw;
+    int weight;
+};
+
+// 错误分类
+enum ErrorType {
+    ERR_CONNECT,        // 连接失败
+    ERR_CLOSED,         // 有请求在途时连接被关闭或重置
+    ERR_TIMEOUT,        // 请求超时
+    ERR_PARSE,          // 响应格式错误
+    ERR_NUM,
+};
+static const char* const ERROR_NAMES[ERR_NUM] = {"connect", "closed", "timeout", "parse"};
+
+struct Stats {
+    std::vector<uint32_t> latencyUs;
+    uint64_t bytes = 0;
+    uint64_t status[6] = {};            // 按状态码的百位统计，下标 0 为无法识别
+    uint64_t errors[ERR_NUM] = {};
+    std::vector<uint64_t> perKind;      // 每种请求完成的数量
+};
+
+struct Pending {
+    int kind;
+    int64_t sentNs;
+};
+
+struct Conn {
+    int fd = -1;
+    bool connecting = false;
+    bool wantOut = false;               // 当前是否监听 EPOLLOUT
+    std::string wbuf;
+    size_t woff = 0;
+    std::string rbuf;
+    std::deque<Pending> inflight;
+    uint32_t rng = 0;
+};
+
+static std::string MakeRequest(const std::string& method, const std::string& path,
+                               const std::string& body, bool keepAlive) {
+    std::string req = method + " " + path + " HTTP/1.1\r\nHost: loadgen\r\n";
+    req += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    if (method == "POST") {
+        req += "Content-Type: application/x-www-form-urlencoded\r\n";
+        req += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    req += "\r\n";
+    return req + body;
+}
+
+static bool ParseMix(const Options& opt, std::vector<RequestKind>* kinds) {
+    size_t pos = 0;
+    while (pos <= opt.mix.size()) {
+        size_t comma = opt.mix.find(',', pos);
+        if (comma == std::string::npos) comma = opt.mix.size();
+        std::string item = opt.mix.substr(pos, comma - pos);
+        pos = comma + 1;
+        if (item.empty()) continue;
+        size_t colon = item.rfind(':');
+        std::string name = item.substr(0, colon);
+        int weight = colon == std::string::npos ? 1 : atoi(item.c_str() + colon + 1);
+        if (weight <= 0) {
+            fprintf(stderr, "bad weight in '%s'\n", item.c_str());
+            return false;
+        }
+        std::string raw;
+        if (name == "index") raw = MakeRequest("GET", "/index.html", "", opt.keepAlive);
+        else if (name == "picture") raw = MakeRequest("GET", "/picture.html", "", opt.keepAlive);
+        else if (name == "image") raw = MakeRequest("GET", "/images/profile-image.jpg", "", opt.keepAlive);
+        else if (name == "css") raw = MakeRequest("GET", "/css/style.css", "", opt.keepAlive);
+        else if (name == "notfound") raw = MakeRequest("GET", "/nope.html", "", opt.keepAlive);
+        else if (name == "login") {
+            raw = MakeRequest("POST", "/login.html", "username=" + opt.user + "&password=" + opt.pwd, opt.keepAlive);
+        }
+        else if (!name.empty() && name[0] == '/') raw = MakeRequest("GET", name, "", opt.keepAlive);
+        else {
+            fprintf(stderr, "unknown request kind '%s'\n", name.c_str());
+            return false;
+        }
+        kinds->push_back({name, raw, weight});
+    }
+    return !kinds->empty();
+}
+
+class Worker {
+public:
+    Worker(const Options& opt, const std::vector<RequestKind>& kinds, int numConns, int id)
+        : opt_(opt), kinds_(kinds), conns_(numConns) {
+        for (auto& k : kinds_) totalWeight_ += k.weight;
+        for (size_t i = 0; i < conns_.size(); i++) {
+            conns_[i].rng = 2654435761u * (id * 1000 + i + 1);
+        }
+        stats_.perKind.assign(kinds_.size(), 0);
+        stats_.latencyUs.reserve(1 << 20);
+    }
+
+    void Run(int64_t measureBeginNs, int64_t endNs) {
+        measureBeginNs_ = measureBeginNs;
+        epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        for (size_t i = 0; i < conns_.size(); i++) Connect_(i);
+
+        std::vector<epoll_event> events(256);
+        int64_t lastScan = NowNs();
+        while (true) {
+            int n = epoll_wait(epfd_, events.data(), events.size(), 10);
+            for (int i = 0; i < n; i++) {
+                size_t idx = events[i].data.u32;
+                Conn& c = conns_[idx];
+                if (c.fd < 0) continue;
+                if (c.connecting) {
+                    OnConnected_(idx);
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    if (!OnRead_(idx)) continue;
+                }
+                if (events[i].events & EPOLLOUT) Flush_(idx);
+            }
+            int64_t now = NowNs();
+            if (now >= endNs) break;
+            if (now - lastScan >= 100 * 1000000LL) {
+                ScanTimeout_(now);
+                lastScan = now;
+            }
+        }
+        for (auto& c : conns_) {
+            if (c.fd >= 0) close(c.fd);
+        }
+        close(epfd_);
+    }
+
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    void Connect_(size_t idx) {
+        Conn& c = conns_[idx];
+        c.wbuf.clear();
+        c.woff = 0;
+        c.rbuf.clear();
+        c.inflight.clear();
+        c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opt_.port);
+        inet_pton(AF_INET, opt_.addr.c_str(), &addr.sin_addr);
+        int ret = connect(c.fd, (sockaddr*)&addr, sizeof(addr));
+        if (ret < 0 && errno != EINPROGRESS) {
+            Error_(ERR_CONNECT);
+            close(c.fd);
+            c.fd = -1;          // 等下一次 ScanTimeout_ 再连，服务器不在时不要空转
+            return;
+        }
+        c.connecting = true;
+        c.wantOut = true;
+        epoll_event ev = {};
+        ev.events = EPOLLOUT;
+        ev.data.u32 = idx;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, c.fd, &ev);
+    }
+
+    void OnConnected_(size_t idx) {
+        Conn& c = conns_[idx];
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            Error_(ERR_CONNECT);
+            epoll_ctl(epfd_, EPOLL_CTL_DEL, c.fd, nullptr);
+            close(c.fd);
+            c.fd = -1;
+            return;
+        }
+        c.connecting = false;
+        Fill_(idx);
+    }
+
+    // 补满流水线；不用长连接时一个连接只发一个请求
+    void Fill_(size_t idx) {
+        Conn& c = conns_[idx];
+        size_t depth = opt_.keepAlive ? opt_.depth : 1;
+        int64_t now = NowNs();
+        while (c.inflight.size() < depth) {
+            int kind = Pick_(c);
+            c.wbuf += kinds_[kind].raw;
+            c.inflight.push_back({kind, now});
+        }
+        Flush_(idx);
+    }
+
+    void Flush_(size_t idx) {
+        Conn& c = conns_[idx];
+        while (c.woff < c.wbuf.size()) {
+            ssize_t n = write(c.fd, c.wbuf.data() + c.woff, c.wbuf.size() - c.woff);
+            if (n < 0) {
+                if (errno == EAGAIN) break;
+                Error_(ERR_CLOSED);
+                Reconnect_(idx);
+                return;
+            }
+            c.woff += n;
+        }
+        if (c.woff == c.wbuf.size()) {
+            c.wbuf.clear();
+            c.woff = 0;
+        }
+        bool wantOut = !c.wbuf.empty();
+        if (wantOut != c.wantOut) {
+            c.wantOut = wantOut;
+            epoll_event ev = {};
+            ev.events = EPOLLIN | (wantOut ? EPOLLOUT : 0);
+            ev.data.u32 = idx;
+            epoll_ctl(epfd_, EPOLL_CTL_MOD, c.fd, &ev);
+        }
+    }
+
+    // 返回 false 表示连接已经重建，这一轮不要再处理它
+    bool OnRead_(size_t idx) {
+        Conn& c = conns_[idx];
+        char buf[65536];
+        bool eof = false;
+        while (true) {
+            ssize_t n = read(c.fd, buf, sizeof(buf));
+            if (n > 0) {
+                c.rbuf.append(buf, n);
+                if (NowNs() >= measureBeginNs_) stats_.bytes += n;
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN) break;
+            eof = true;
+            break;
+        }
+        bool closeAfter = false;
+        size_t off = 0;
+        while (!c.inflight.empty()) {
+            int ret = ParseResponse_(c, &off, &closeAfter);
+            if (ret == 0) break;
+            if (ret < 0) {
+                Error_(ERR_PARSE);
+                Reconnect_(idx);
+                return false;
+            }
+            if (closeAfter) break;
+        }
+        c.rbuf.erase(0, off);
+        if (closeAfter || eof) {
+            if (!c.inflight.empty()) Error_(ERR_CLOSED);
+            Reconnect_(idx);
+            return false;
+        }
+        Fill_(idx);
+        return true;
+    }
+
+    // 从 rbuf 的 off 处解析一个完整响应：1 完成，0 数据不够，-1 格式错误
+    int ParseResponse_(Conn& c, size_t* off, bool* closeAfter) {
+        size_t headEnd = c.rbuf.find("\r\n\r\n", *off);
+        if (headEnd == std::string::npos) return 0;
+        const char* head = c.rbuf.data() + *off;
+        size_t headLen = headEnd + 4 - *off;
+        if (headLen < 12 || strncmp(head, "HTTP/1.", 7) != 0) return -1;
+        int code = atoi(head + 9);
+        size_t bodyLen = 0;
+        bool close = false;
+        // 逐行找 Content-length 和 Connection
+        size_t line = *off;
+        while (line < headEnd) {
+            size_t eol = c.rbuf.find("\r\n", line);
+            const char* p = c.rbuf.data() + line;
+            size_t len = eol - line;
+            if (len > 15 && strncasecmp(p, "Content-length:", 15) == 0) bodyLen = strtoul(p + 15, nullptr, 10);
+            else if (len > 11 && strncasecmp(p, "Connection:", 11) == 0 && strstr(std::string(p, len).c_str(), "close")) close = true;
+            line = eol + 2;
+        }
+        if (c.rbuf.size() - *off < headLen + bodyLen) return 0;
+        *off += headLen + bodyLen;
+
+        Pending pending = c.inflight.front();
+        c.inflight.pop_front();
+        int64_t now = NowNs();
+        if (pending.sentNs >= measureBeginNs_) {
+            stats_.latencyUs.push_back(static_cast<uint32_t>((now - pending.sentNs) / 1000));
+            stats_.status[code >= 100 && code < 600 ? code / 100 : 0]++;
+            stats_.perKind[pending.kind]++;
+        }
+        *closeAfter = close;
+        return 1;
+    }
+
+    // 超时的请求断开重连，连接失败的重新连接
+    void ScanTimeout_(int64_t now) {
+        int64_t limit = static_cast<int64_t>(opt_.timeoutMs) * 1000000;
+        for (size_t i = 0; i < conns_.size(); i++) {
+            Conn& c = conns_[i];
+            if (c.fd < 0) {
+                Connect_(i);
+            }
+            else if (!c.inflight.empty() && now - c.inflight.front().sentNs > limit) {
+                Error_(ERR_TIMEOUT);
+                Reconnect_(i);
+            }
+        }
+    }
+
+    void Reconnect_(size_t idx) {
+        Conn& c = conns_[idx];
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, c.fd, nullptr);
+        close(c.fd);
+        c.fd = -1;
+        Connect_(idx);
+    }
+
+    int Pick_(Conn& c) {
+        if (kinds_.size() == 1) return 0;
+        // xorshift32
+        c.rng ^= c.rng << 13;
+        c.rng ^= c.rng >> 17;
+        c.rng ^= c.rng << 5;
+        int r = c.rng % totalWeight_;
+        for (size_t i = 0; i < kinds_.size(); i++) {
+            r -= kinds_[i].weight;
+            if (r < 0) return i;
+        }
+        return 0;
+    }
+
+    void Error_(ErrorType type) {
+        if (NowNs() >= measureBeginNs_) stats_.errors[type]++;
+    }
+
+    const Options& opt_;
+    const std::vector<RequestKind>& kinds_;
+    int totalWeight_ = 0;
+    std::vector<Conn> conns_;
+    int epfd_ = -1;
+    int64_t measureBeginNs_ = 0;
+    Stats stats_;
+};
+
+static uint32_t Percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+static void Usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-a addr] [-p port] [-c conns] [-t threads] [-d seconds] [-w warmup]\n"
+                    "          [-P depth] [-K] [-m mix] [-u user] [-s pwd] [-T timeoutMs] [-j]\n"
+                    "  mix: comma separated name:weight, name in index,picture,image,css,notfound,login or /path\n",
+            prog);
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    int ch;
+    while ((ch = getopt(argc, argv, "a:p:c:t:d:w:P:Km:u:s:T:jh")) != -1) {
+        switch (ch) {
+        case 'a': opt.addr = optarg; break;
+        case 'p': opt.port = atoi(optarg); break;
+        case 'c': opt.conns = atoi(optarg); break;
+        case 't': opt.threads = atoi(optarg); break;
+        case 'd': opt.duration = atoi(optarg); break;
+        case 'w': opt.warmup = atoi(optarg); break;
+        case 'P': opt.depth = atoi(optarg); break;
+        case 'K': opt.keepAlive = false; break;
+        case 'm': opt.mix = optarg; break;
+        case 'u': opt.user = optarg; break;
+        case 's': opt.pwd = optarg; break;
+        case 'T': opt.timeoutMs = atoi(optarg); break;
+        case 'j': opt.json = true; break;
+        default: Usage(argv[0]); return 2;
+        }
+    }
+    if (opt.conns <= 0 || opt.threads <= 0 || opt.duration <= 0 || opt.warmup < 0 || opt.depth <= 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+    opt.threads = std::min(opt.threads, opt.conns);
+    std::vector<RequestKind> kinds;
+    if (!ParseMix(opt, &kinds)) return 2;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < opt.threads; i++) {
+        int n = opt.conns / opt.threads + (i < opt.conns % opt.threads ? 1 : 0);
+        workers.emplace_back(new Worker(opt, kinds, n, i));
+    }
+    int64_t begin = NowNs() + static_cast<int64_t>(opt.warmup) * 1000000000;
+    int64_t end = begin + static_cast<int64_t>(opt.duration) * 1000000000;
+    std::vector<std::thread> threads;
+    for (auto& w : workers) {
+        threads.emplace_back([&w, begin, end] { w->Run(begin, end); });
+    }
+    for (auto& t : threads) t.join();
+
+    // 汇总
+    Stats total;
+    total.perKind.assign(kinds.size(), 0);
+    for (auto& w : workers) {
+        const Stats& s = w->GetStats();
+        total.latencyUs.insert(total.latencyUs.end(), s.latencyUs.begin(), s.latencyUs.end());
+        total.bytes += s.bytes;
+        for (int i = 0; i < 6; i++) total.status[i] += s.status[i];
+        for (int i = 0; i < ERR_NUM; i++) total.errors[i] += s.errors[i];
+        for (size_t i = 0; i < kinds.size(); i++) total.perKind[i] += s.perKind[i];
+    }
+    std::sort(total.latencyUs.begin(), total.latencyUs.end());
+    const std::vector<uint32_t>& lat = total.latencyUs;
+    uint64_t done = lat.size();
+    uint64_t errors = 0;
+    for (int i = 0; i < ERR_NUM; i++) errors += total.errors[i];
+    double rps = done / static_cast<double>(opt.duration);
+    double mbps = total.bytes / static_cast<double>(opt.duration) / (1 << 20);
+    double mean = 0;
+    for (uint32_t us : lat) mean += us;
+    if (done) mean /= done;
+    uint32_t maxUs = done ? lat.back() : 0;
+
+    if (opt.json) {
+        printf("{\"conns\":%d,\"threads\":%d,\"duration\":%d,\"depth\":%d,\"keepalive\":%s,\"mix\":\"%s\","
+               "\"requests\":%llu,\"rps\":%.1f,\"mbps\":%.2f,"
+               "\"latency_us\":{\"mean\":%.1f,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u},"
+               "\"status\":{\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,\"5xx\":%llu,\"other\":%llu},\"errors\":{",
+               opt.conns, opt.threads, opt.duration, opt.depth, opt.keepAlive ? "true" : "false", opt.mix.c_str(),
+               (unsigned long long)done, rps, mbps, mean,
+               Percentile(lat, 0.5), Percentile(lat, 0.9), Percentile(lat, 0.99), Percentile(lat, 0.999), maxUs,
+               (unsigned long long)total.status[2], (unsigned long long)total.status[3],
+               (unsigned long long)total.status[4], (unsigned long long)total.status[5],
+               (unsigned long long)(total.status[0] + total.status[1]));
+        for (int i = 0; i < ERR_NUM; i++) {
+            printf("%s\"%s\":%llu", i ? "," : "", ERROR_NAMES[i], (unsigned long long)total.errors[i]);
+        }
+        printf("}}\n");
+    }
+    else {
+        printf("%d connections, %d threads, %ds (+%ds warmup), depth %d, %s, mix %s\n",
+               opt.conns, opt.threads, opt.duration, opt.warmup, opt.depth,
+               opt.keepAlive ? "keep-alive" : "close", opt.mix.c_str());
+        printf("  requests  %llu   %.1f req/s   %.2f MB/s\n", (unsigned long long)done, rps, mbps);
+        printf("  latency   mean %.1fus  p50 %uus  p90 %uus  p99 %uus  p999 %uus  max %uus\n", mean,
+               Percentile(lat, 0.5), Percentile(lat, 0.9), Percentile(lat, 0.99), Percentile(lat, 0.999), maxUs);
+        printf("  status    2xx %llu  3xx %llu  4xx %llu  5xx %llu  other %llu\n",
+               (unsigned long long)total.status[2], (unsigned long long)total.status[3],
+               (unsigned long long)total.status[4], (unsigned long long)total.status[5],
+               (unsigned long long)(total.status[0] + total.status[1]));
+        printf("  errors   ");
+        for (int i = 0; i < ERR_NUM; i++) printf(" %s %llu", ERROR_NAMES[i], (unsigned long long)total.errors[i]);
+        printf("\n  per kind ");
+        for (size_t i = 0; i < kinds.size(); i++) {
+            printf(" %s %llu", kinds[i].name.c_str(), (unsigned long long)total.perKind[i]);
+        }
+        printf("\n");
+    }
+    return errors > 0 || done == 0 ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * 日志前台开销的基准测试
+ * 1/2/4/8 个线程同时写典型的请求日志，每次写一小批（放得进环形缓冲区）再歇一会儿，
+ * 测量调用方每条日志花的时间（不含写线程写文件的时间），以及写线程把全部日志写完的总吞吐：
+ *   text      在调用线程里 vsnprintf 格式化好再放进环形缓冲区
+ *   deferred  只把格式串指针、时间戳和原始参数编码进环形缓冲区，由写线程格式化
+ * 两种模式分别在子进程里跑（Log 是单例，只能 init 一次），结果通过管道交给父进程，日志写到 /tmp/log_bench
+ * 用法：./bin/log_bench [--json]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../code/log/Log.h"
+#include "BenchReport.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+static const int BURSTS = 200;
+static const int BURST_LINES = 256;     // 一批两种日志各 256 条，约 40KB，小于环形缓冲区
+
+static double RunThreads(int threads) {
+    std::vector<std::thread> workers;
+    std::vector<double> ns(threads);
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([t, &ns] {
+            std::string path = "/index.html";
+            double total = 0;
+            for (int b = 0; b < BURSTS; b++) {
+                auto start = BenchClock::now();
+                for (int i = 0; i < BURST_LINES; i++) {
+                    LOG_INFO("Client[%d](%s:%d) in, userCount:%d", 1000 + i % 512, "127.0.0.1", 40000 + t, i);
+                    LOG_DEBUG("[%s], filesize: %zu, %.3f ms", path.c_str(), static_cast<size_t>(i) * 17, i * 0.001);
+                }
+                total += std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            ns[t] = total / (2.0 * BURSTS * BURST_LINES);
+        });
+    }
+    double sum = 0;
+    for (int t = 0; t < threads; t++) {
+        workers[t].join();
+        sum += ns[t];
+    }
+    return sum / threads;
+}
+
+int main(int argc, char* argv[]) {
+    BenchReport report("log", argc, argv);
+    const int threadCounts[] = {1, 2, 4, 8};
+    if (!report.Json()) printf("%-10s %8s %12s %10s\n", "mode", "threads", "ns/line", "dropped");
+    for (int deferred = 0; deferred < 2; deferred++) {
+        for (int threads : threadCounts) {
+            struct {
+                double ns;
+                size_t dropped;
+            } result = {0, 0};
+            int fds[2];
+            if (pipe(fds) < 0) return 1;
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                Log::Instance()->init(0, "/tmp/log_bench", ".log", 1024, deferred);
+                result.ns = RunThreads(threads);
+                result.dropped = Log::Instance()->Dropped();
+                ssize_t n = write(fds[1], &result, sizeof(result));
+                (void)n;
+                _exit(0);
+            }
+            close(fds[1]);
+            ssize_t n = read(fds[0], &result, sizeof(result));
+            (void)n;
+            close(fds[0]);
+            waitpid(pid, nullptr, 0);
+            const char* mode = deferred ? "deferred" : "text";
+            if (!report.Json()) printf("%-10s %8d %12.1f %10zu\n", mode, threads, result.ns, result.dropped);
+            report.Add(std::string(mode) + "/" + std::to_string(threads), result.ns, "ns/line");
+        }
+    }
+    system("rm -rf /tmp/log_bench");
+    return 0;
+}
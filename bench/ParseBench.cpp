@@ -0,0 +1,142 @@
+/*
+ * HttpRequest::Parse 的基准测试
+ * 对比旧的 std::regex 逐行解析（LegacyParse）和现在的增量状态机解析，输出单核每秒可解析的请求数。
+ * 用法：./bin/parse_bench [每个样本的迭代次数] [--json]
+ */
+#include <chrono>
+#include <regex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../code/buffer/Buffer.h"
+#include "../code/http/HttpRequest.h"
+#include "BenchReport.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+// 从浏览器和 webbench 抓到的典型请求
+static const std::vector<std::string> CORPUS = {
+    "GET / HTTP/1.1\r\nHost: 127.0.0.1:9006\r\n\r\n",
+    "GET /index.html HTTP/1.0\r\nUser-Agent: WebBench 1.5\r\nHost: 127.0.0.1\r\n\r\n",
+    "GET /css/bootstrap.min.css HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0 Safari/537.36\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Referer: http://127.0.0.1:9006/\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n\r\n",
+    "GET /images/profile-image.jpg HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/*,*/*;q=0.8\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef\r\n\r\n",
+    "POST /login.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 31\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Origin: http://127.0.0.1:9006\r\n"
+    "Referer: http://127.0.0.1:9006/login.html\r\n\r\n"
+    "username=alice&password=s3cr%21",
+};
+
+// 旧实现：每行构造 std::string 和 std::regex
+static bool LegacyParse(Buffer& buff) {
+    const char END[] = "\r\n";
+    int state = 0;
+    std::string method, path, version;
+    std::unordered_map<std::string, std::string> header;
+    while (buff.ReadableBytes() && state != 3) {
+        const char* lineEnd = std::search(buff.Peek(), buff.BeginWriteConst(), END, END + 2);
+        std::string line(buff.Peek(), lineEnd);
+        if (state == 0) {
+            std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+            std::smatch match;
+            if (!std::regex_match(line, match, patten)) return false;
+            method = match[1]; path = match[2]; version = match[3];
+            state = 1;
+        }
+        else if (state == 1) {
+            std::regex patten("^([^:]*): ?(.*)$");
+            std::smatch match;
+            if (std::regex_match(line, match, patten)) header[match[1]] = match[2];
+            else state = 2;
+            if (buff.ReadableBytes() <= 2) state = 3;
+        }
+        if (lineEnd == buff.BeginWrite()) { buff.RetrieveAll(); break; }
+        buff.RetrieveUntil(lineEnd + 2);
+    }
+    return true;
+}
+
+static double RunLegacy(int iters) {
+    Buffer buff;
+    size_t n = 0;
+    auto start = BenchClock::now();
+    for (int i = 0; i < iters; i++) {
+        for (const auto& req : CORPUS) {
+            buff.Append(req);
+            n += LegacyParse(buff);
+            buff.RetrieveAll();
+        }
+    }
+    std::chrono::duration<double> sec = BenchClock::now() - start;
+    return n / sec.count();
+}
+
+static double RunIncremental(int iters) {
+    Buffer buff;
+    HttpRequest request;
+    size_t n = 0;
+    auto start = BenchClock::now();
+    for (int i = 0; i < iters; i++) {
+        for (const auto& req : CORPUS) {
+            buff.Append(req);
+            n += request.Parse(buff) == HttpRequest::GET_REQUEST;
+            buff.Retrieve(request.RequestLen());
+            request.Init();
+        }
+    }
+    std::chrono::duration<double> sec = BenchClock::now() - start;
+    return n / sec.count();
+}
+
+// 每个请求拆成两半分两次到达，验证增量解析的续传开销
+static double RunIncrementalSplit(int iters) {
+    Buffer buff;
+    HttpRequest request;
+    size_t n = 0;
+    auto start = BenchClock::now();
+    for (int i = 0; i < iters; i++) {
+        for (const auto& req : CORPUS) {
+            size_t half = req.size() / 2;
+            buff.Append(req.data(), half);
+            request.Parse(buff);
+            buff.Append(req.data() + half, req.size() - half);
+            n += request.Parse(buff) == HttpRequest::GET_REQUEST;
+            buff.Retrieve(request.RequestLen());
+            request.Init();
+        }
+    }
+    std::chrono::duration<double> sec = BenchClock::now() - start;
+    return n / sec.count();
+}
+
+int main(int argc, char* argv[]) {
+    BenchReport report("parse", argc, argv);
+    int iters = argc > 1 ? atoi(argv[1]) : 20000;
+    double legacy = RunLegacy(iters / 20 > 0 ? iters / 20 : 1);
+    double incr = RunIncremental(iters);
+    double split = RunIncrementalSplit(iters);
+    if (!report.Json()) {
+        printf("%-24s %14.0f req/s\n", "legacy regex", legacy);
+        printf("%-24s %14.0f req/s  (x%.1f)\n", "incremental", incr, incr / legacy);
+        printf("%-24s %14.0f req/s  (x%.1f)\n", "incremental (split)", split, split / legacy);
+    }
+    report.Add("legacy", legacy, "req/s");
+    report.Add("incremental", incr, "req/s");
+    report.Add("incremental-split", split, "req/s");
+    return 0;
+}
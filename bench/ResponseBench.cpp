@@ -0,0 +1,91 @@
+/*
+ * HttpResponse::MakeResponse 的基准测试
+ * 分别测量命中文件缓存和不走缓存（stat/open/mmap）两种情况下每秒生成的响应数，
+ * 并替换全局 operator new 统计每个响应的堆分配次数。
+ * 用法：在仓库根目录下运行 ./bin/response_bench [迭代次数] [--json]
+ */
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../code/buffer/Buffer.h"
+#include "../code/http/HttpResponse.h"
+#include "../code/http/FileCache.h"
+#include "BenchReport.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+static std::atomic<size_t> allocCount(0);
+
+void* operator new(size_t size) {
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static const std::vector<std::string> HIT_PATHS = {
+    "/index.html", "/css/style.css", "/js/custom.js", "/images/profile-image.jpg",
+};
+
+static const std::vector<std::string> MISS_PATHS = {
+    "/nope.html",
+};
+
+static void Run(BenchReport& report, const char* name, const char* srcDir,
+                const std::vector<std::string>& corpus, int iters) {
+    Buffer buff(4096);
+    HttpResponse response;
+    std::vector<std::string> paths(corpus);
+
+    // 预热：让缓存装入文件、path_ 等成员分配好容量
+    for (auto& path : paths) {
+        response.Init(srcDir, path, true, 200);
+        response.MakeResponse(buff);
+        buff.RetrieveAll();
+    }
+
+    size_t allocBefore = allocCount.load();
+    auto start = BenchClock::now();
+    for (int i = 0; i < iters; i++) {
+        for (auto& path : paths) {
+            response.Init(srcDir, path, true, 200);
+            response.MakeResponse(buff);
+            buff.Retrieve(buff.ReadableBytes());
+        }
+    }
+    std::chrono::duration<double> sec = BenchClock::now() - start;
+    response.UnmapFile();
+    size_t n = static_cast<size_t>(iters) * paths.size();
+    double allocs = static_cast<double>(allocCount.load() - allocBefore) / n;
+    if (!report.Json()) {
+        printf("%-16s %12.0f resp/s %8.1f ns/resp %6.2f allocs/resp\n", name, n / sec.count(),
+               sec.count() * 1e9 / n, allocs);
+    }
+    report.Add(std::string(name) + "/time", sec.count() * 1e9 / n, "ns/resp");
+    report.Add(std::string(name) + "/allocs", allocs, "allocs/resp");
+}
+
+int main(int argc, char* argv[]) {
+    BenchReport report("response", argc, argv);
+    int iters = argc > 1 ? atoi(argv[1]) : 100000;
+    const char* srcDir = "./resources/";
+
+    FileCache::Instance()->Init(srcDir, 0);     // 容量为 0，关闭缓存
+    Run(report, "200 uncached", srcDir, HIT_PATHS, iters / 10 > 0 ? iters / 10 : 1);
+
+    FileCache::Instance()->Init(srcDir);
+    Run(report, "200 cached", srcDir, HIT_PATHS, iters);
+    Run(report, "404", srcDir, MISS_PATHS, iters / 10 > 0 ? iters / 10 : 1);
+    return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * ThreadPool 的基准测试
+ * 对比原来的 互斥锁 + 条件变量 + std::function 线程池 和 现在的无锁工作窃取线程池：
+ * 多个生产者同时提交只捕获几个指针的小任务，分别测量吞吐量（任务/秒）以及
+ * 任务从提交到开始执行的延迟（平均值和 p99）。
+ * 计时之前先检查任务在队列中移动后捕获的对象是否完好、是否恰好析构一次，不对就退出。
+ * 用法：在仓库根目录下运行 ./bin/threadpool_bench [每个生产者提交的任务数] [--json]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "../code/pool/ThreadPool.h"
+#include "BenchReport.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+// 原来的线程池实现，只用于对比
+class LegacyThreadPool {
+public:
+    explicit LegacyThreadPool(int numThreads) : isClosed_(false) {
+        for (int i = 0; i < numThreads; i++) {
+            threads_.emplace_back([this] {
+                while (true) {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    condition_.wait(lock, [this] { return !tasks_.empty() || isClosed_; });
+                    if (isClosed_ && tasks_.empty()) {
+                        return;
+                    }
+                    std::function<void()> task(std::move(tasks_.front()));
+                    tasks_.pop();
+                    lock.unlock();
+                    task();
+                }
+            });
+        }
+    }
+
+    ~LegacyThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            isClosed_ = true;
+        }
+        condition_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    template<class F>
+    void AddTask(F&& f) {
+        std::function<void()> task = std::forward<F>(f);
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            tasks_.emplace(std::move(task));
+        }
+        condition_.notify_one();
+    }
+
+private:
+    std::vector<std::thread> threads_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mtx_;
+    std::condition_variable condition_;
+    bool isClosed_;
+};
+
+static const int PRODUCERS = 4;
+static const int LATENCY_SAMPLE = 64;       // 每隔多少个任务记录一次延迟
+
+struct Result {
+    double tasksPerSec;
+    double avgUs;
+    double p99Us;
+};
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        BenchClock::now().time_since_epoch()).count();
+}
+
+// 模拟 OnRead_/OnWrite_ 的任务：捕获几个指针，做一点点工作
+template<class Pool>
+static Result Run(int threads, int perProducer) {
+    std::atomic<int64_t> done(0);
+    std::atomic<int64_t> sink(0);
+    int total = perProducer * PRODUCERS;
+    std::vector<int64_t> latency(total / LATENCY_SAMPLE + PRODUCERS, 0);
+    std::atomic<size_t> latencyCnt(0);
+
+    int64_t start = NowNs();
+    {
+        Pool pool(threads);
+        std::vector<std::thread> producers;
+        for (int p = 0; p < PRODUCERS; p++) {
+            producers.emplace_back([&, p] {
+                for (int i = 0; i < perProducer; i++) {
+                    int64_t submit = (i % LATENCY_SAMPLE == 0) ? NowNs() : 0;
+                    std::atomic<int64_t>* d = &done;
+                    std::atomic<int64_t>* s = &sink;
+                    std::vector<int64_t>* lat = &latency;
+                    std::atomic<size_t>* latCnt = &latencyCnt;
+                    pool.AddTask([d, s, lat, latCnt, submit, i] {
+                        if (submit) {
+                            size_t idx = latCnt->fetch_add(1, std::memory_order_relaxed);
+                            if (idx < lat->size()) (*lat)[idx] = NowNs() - submit;
+                        }
+                        s->fetch_add(i, std::memory_order_relaxed);
+                        d->fetch_add(1, std::memory_order_release);
+                    });
+                }
+                (void)p;
+            });
+        }
+        for (auto& t : producers) {
+            t.join();
+        }
+        while (done.load(std::memory_order_acquire) < total) {
+            std::this_thread::yield();
+        }
+    }
+    int64_t elapsed = NowNs() - start;
+
+    size_t n = std::min(latencyCnt.load(), latency.size());
+    std::sort(latency.begin(), latency.begin() + n);
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) sum += latency[i];
+
+    Result r;
+    r.tasksPerSec = total * 1e9 / elapsed;
+    r.avgUs = n ? sum / n / 1000.0 : 0;
+    r.p99Us = n ? latency[n * 99 / 100] / 1000.0 : 0;
+    return r;
+}
+
+// 记录存活的对象个数，析构两次或者漏掉析构都会让它最后不为 0
+struct Tracked {
+    static std::atomic<int> alive;
+    std::string text;
+    explicit Tracked(const std::string& s) : text(s) { alive++; }
+    Tracked(const Tracked& other) : text(other.text) { alive++; }
+    Tracked(Tracked&& other) noexcept : text(std::move(other.text)) { alive++; }
+    ~Tracked() { alive--; }
+};
+std::atomic<int> Tracked::alive(0);
+
+// 捕获非平凡析构对象的小任务（放在 Task 内部）和超过 INLINE_SIZE 的大任务（放在堆上），
+// 经过队列的移动、窃取后内容不变，每个对象恰好析构一次
+static bool CheckTaskMove() {
+    const int N = 20000;
+    std::atomic<int> ok(0);
+    {
+        ThreadPool pool(4);
+        for (int i = 0; i < N; i++) {
+            std::string text = "task-" + std::to_string(i) + std::string(40, 'x');
+            Tracked small(text);
+            pool.AddTask([small, text, &ok] {
+                if (small.text == text) ok++;
+            });
+            char pad[128];
+            memset(pad, i & 0x7f, sizeof(pad));
+            Task big([small, pad, i, &ok] {
+                bool same = small.text.compare(0, 5, "task-") == 0;
+                for (char c : pad) same = same && c == (i & 0x7f);
+                if (same) ok++;
+            });
+            Task moved(std::move(big));
+            big = std::move(moved);
+            pool.AddTask(std::move(big));
+        }
+    }
+    if (ok.load() != 2 * N || Tracked::alive.load() != 0) {
+        fprintf(stderr, "task move check failed: ok %d/%d alive %d\n", ok.load(), 2 * N, Tracked::alive.load());
+        return false;
+    }
+    return true;
+}
+
+static void Print(BenchReport& report, int threads, const char* pool, const Result& r) {
+    if (!report.Json()) {
+        printf("%8d %-10s %14.0f %10.2f %10.2f\n", threads, pool, r.tasksPerSec, r.avgUs, r.p99Us);
+    }
+    std::string prefix = std::string(pool) + "/" + std::to_string(threads) + "/";
+    report.Add(prefix + "throughput", r.tasksPerSec, "tasks/s");
+    report.Add(prefix + "avg", r.avgUs, "us");
+    report.Add(prefix + "p99", r.p99Us, "us");
+}
+
+int main(int argc, char* argv[]) {
+    BenchReport report("threadpool", argc, argv);
+    int perProducer = 200000;
+    if (argc > 1) {
+        perProducer = atoi(argv[1]);
+    }
+
+    if (!CheckTaskMove()) {
+        return 1;
+    }
+
+    if (!report.Json()) {
+        printf("producers=%d tasks/producer=%d\n", PRODUCERS, perProducer);
+        printf("%8s %-10s %14s %10s %10s\n", "threads", "pool", "tasks/s", "avg(us)", "p99(us)");
+    }
+    const int THREADS[] = {1, 2, 4, 8, 16, 32, 64};
+    for (int t : THREADS) {
+        Print(report, t, "mutex", Run<LegacyThreadPool>(t, perProducer));
+        Print(report, t, "stealing", Run<ThreadPool>(t, perProducer));
+    }
+    return 0;
+}
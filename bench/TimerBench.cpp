@@ -0,0 +1,103 @@
+/*
+ * HeapTimer 和 TimingWheel 的基准测试
+ * 在 1 万 ~ 100 万个定时器下分别测量：
+ *   add     每个 id 添加一个 60s 左右的定时器
+ *   adjust  随机挑连接延长超时（对应 WebServer::ExtentTime_，每次读写事件都会调用）
+ *   expire  定时器全部到期后一次 Tick 触发所有回调
+ *   delete  删除所有定时器（HeapTimer 没有单独的删除接口，用 DoWork 代替）
+ * 用法：在仓库根目录下运行 ./bin/timer_bench [--json]
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "../code/timer/HeepTimer.h"
+#include "../code/timer/TimingWheel.h"
+#include "BenchReport.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double NsPerOp(BenchClock::time_point start, size_t ops) {
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / ops;
+}
+
+struct Result {
+    double add;
+    double adjust;
+    double expire;
+    double del;
+};
+
+template<class Timer>
+static Result Run(int n) {
+    Result r;
+    std::mt19937 rng(n);
+    std::vector<int> ids(n);
+    for (int i = 0; i < n; i++) ids[i] = rng() % n;
+    size_t fired = 0;
+    TimeoutCallback cb = [&fired] { fired++; };
+
+    {
+        Timer timer;
+        auto start = BenchClock::now();
+        for (int i = 0; i < n; i++) {
+            timer.Add(i, 60000 + i % 1000, cb);
+        }
+        r.add = NsPerOp(start, n);
+
+        start = BenchClock::now();
+        for (int round = 0; round < 4; round++) {
+            for (int i = 0; i < n; i++) {
+                timer.Adjust(ids[i], 60000 + round);
+            }
+        }
+        r.adjust = NsPerOp(start, 4 * n);
+
+        start = BenchClock::now();
+        for (int i = 0; i < n; i++) {
+            timer.DoWork(i);
+        }
+        r.del = NsPerOp(start, n);
+    }
+    {
+        Timer timer;
+        for (int i = 0; i < n; i++) {
+            timer.Add(i, 1, cb);
+        }
+        usleep(20 * 1000);
+        fired = 0;
+        auto start = BenchClock::now();
+        timer.Tick();
+        r.expire = NsPerOp(start, n);
+        if (fired != static_cast<size_t>(n)) {
+            printf("  warning: only %zu of %d timers fired\n", fired, n);
+        }
+    }
+    return r;
+}
+
+static void Print(BenchReport& report, int n, const char* impl, const Result& r) {
+    if (!report.Json()) {
+        printf("%10d %-12s %12.1f %12.1f %12.1f %12.1f\n", n, impl, r.add, r.adjust, r.expire, r.del);
+    }
+    std::string prefix = std::string(impl) + "/" + std::to_string(n) + "/";
+    report.Add(prefix + "add", r.add, "ns/op");
+    report.Add(prefix + "adjust", r.adjust, "ns/op");
+    report.Add(prefix + "expire", r.expire, "ns/op");
+    report.Add(prefix + "delete", r.del, "ns/op");
+}
+
+int main(int argc, char* argv[]) {
+    BenchReport report("timer", argc, argv);
+    if (!report.Json()) {
+        printf("%10s %-12s %12s %12s %12s %12s\n", "timers", "impl", "add(ns)", "adjust(ns)", "expire(ns)", "delete(ns)");
+    }
+    const int SIZES[] = {10000, 100000, 1000000};
+    for (int n : SIZES) {
+        Print(report, n, "HeapTimer", Run<HeapTimer>(n));
+        Print(report, n, "TimingWheel", Run<TimingWheel>(n));
+    }
+    return 0;
+}
@@ -1,11 +1,20 @@
 #include "Buffer.h"
 
+#include <algorithm>
+
+char Buffer::emptyBuff_[1];
+
 Buffer::Buffer(int BufferSize) : 
-    buffer_(BufferSize), readPos_(0), writePos_(0) {}
+    buffer_(emptyBuff_), capacity_(0), initSize_(BufferSize > 0 ? BufferSize : 1024),
+    readPos_(0), writePos_(0) {}
+
+Buffer::~Buffer() {
+    Release();
+}
 
 // buffer大小 - 写下标
 size_t Buffer::WritableBytes() const {
-    return buffer_.size() - writePos_;
+    return capacity_ - writePos_;
 }
 
 // 写下标 - 读下标
@@ -36,7 +45,11 @@ void Buffer::HasWritten(size_t len) {
 }
 
 void Buffer::Retrieve(size_t len) {
+    assert(len <= ReadableBytes());
     readPos_ += len;
+    if (readPos_ == writePos_) {
+        readPos_ = writePos_ = 0;   // 读空了就回到开头，后面的数据不用再搬动
+    }
 }
 
 // 读指针前移
@@ -45,12 +58,24 @@ void Buffer::RetrieveUntil(const char* end) {
     Retrieve(end - Peek());
 }
 
-// 取出所有数据，buffer归零，读写下标归零,在别的函数中会用到
+// 取出所有数据，读写下标归零,在别的函数中会用到（旧数据由下标界定，不需要清零）
 void Buffer::RetrieveAll() {
-    bzero(&buffer_[0], buffer_.size());
     readPos_ = writePos_ = 0;
 }
 
+void Buffer::Release() {
+    if (capacity_ > 0) {
+        BufferPool::Instance()->Deallocate(buffer_, capacity_);
+    }
+    buffer_ = emptyBuff_;
+    capacity_ = 0;
+    readPos_ = writePos_ = 0;
+}
+
+size_t Buffer::Capacity() const {
+    return capacity_;
+}
+
 // 将缓冲区中的所有可读数据提取出来并返回为一个字符串
 std::string Buffer::RetrieveAllToStr() {
     std::string str(Peek(), ReadableBytes());
@@ -91,6 +116,9 @@ void Buffer::Append(const Buffer& buff) {
 ssize_t Buffer::ReadFd(int fd, int* Errno) {
     char buff[65535];
     struct iovec iov[2];
+    if (capacity_ == 0) {
+        EnsureWritable(initSize_);      // 空闲时释放了存储，有数据来了再取回来
+    }
     size_t writeable = WritableBytes(); // 记录能写多少数据
     // 分散读，保证数据全部读完
     iov[0].iov_base = BeginWrite();
@@ -104,7 +132,7 @@ ssize_t Buffer::ReadFd(int fd, int* Errno) {
     } else if (static_cast<size_t>(len) <= writeable) {     // 若len小于writable，说明写区可以容纳len个字节
         writePos_ += len;
     } else {
-        writePos_ = buffer_.size();     // 写区写满了,下标移到最后
+        writePos_ = capacity_;          // 写区写满了,下标移到最后
         Append(buff, static_cast<size_t>(len - writeable));     // 将剩余的数据添加到buffer中
     }
     return len;
@@ -122,18 +150,30 @@ ssize_t Buffer::WriteFd(int fd, int* Errno) {
 }
 
 char* Buffer::BeginPtr_() {
-    return &buffer_[0];
+    return buffer_;
 }
 
 const char* Buffer::BeginPtr_() const{
-    return &buffer_[0];
+    return buffer_;
 }
 
 // 在进行写入操作之前，确保缓冲区有足够的空间来容纳要写入的数据，
 // 并且在数据被丢弃之前尽可能地移动已有的数据以腾出空间
 void Buffer::MakeSpace_(size_t len) {
     if (WritableBytes() + PrependableBytes() < len) {
-        buffer_.resize(writePos_ + len + 1);
+        // 换一块更大的存储（至少翻倍），只搬动还没读的数据
+        size_t readable = ReadableBytes();
+        size_t need = std::max(readable + len, std::max(initSize_, capacity_ * 2));
+        size_t cap = 0;
+        char* buff = BufferPool::Instance()->Allocate(need, &cap);
+        std::copy(Peek(), Peek() + readable, buff);
+        if (capacity_ > 0) {
+            BufferPool::Instance()->Deallocate(buffer_, capacity_);
+        }
+        buffer_ = buff;
+        capacity_ = cap;
+        readPos_ = 0;
+        writePos_ = readable;
     }
     else {
         size_t readable = ReadableBytes();
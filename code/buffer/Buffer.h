@@ -10,10 +10,15 @@
 #include <string>
 #include <atomic>
 
+#include "BufferPool.h"
+
 class Buffer{
 public:
-    Buffer(int initBuffSize = 1024);
-    ~Buffer() = default;
+    Buffer(int initBuffSize = 1024);    // 构造时不分配内存，第一次写入时才从 BufferPool 取
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
 
     size_t WritableBytes() const;       // 返回可写的字节数
     size_t ReadableBytes() const;        // 返回可读的字节数
@@ -28,6 +33,9 @@ public:
     void RetrieveAll();                 // 读指针归零
     std::string RetrieveAllToStr();
 
+    void Release();                     // 清空并把存储还给 BufferPool，空闲连接不再占用缓冲区内存
+    size_t Capacity() const;
+
     const char* BeginWriteConst() const;    // 返回写指针
     char* BeginWrite();
 
@@ -44,7 +52,11 @@ private:
     const char* BeginPtr_() const;      // 返回缓冲区的头指针
     void MakeSpace_(size_t len);        // 确保有足够的空间
 
-    std::vector<char> buffer_;              // 缓冲区
+    static char emptyBuff_[1];              // 没有存储时指向这里，Peek()/BeginWrite() 总是返回有效指针
+
+    char* buffer_;                          // 缓冲区，来自 BufferPool
+    size_t capacity_;
+    size_t initSize_;                       // 第一次分配的大小
     std::atomic<std::size_t> readPos_;      // 读的下标
     std::atomic<std::size_t> writePos_;     // 写的下标
 };
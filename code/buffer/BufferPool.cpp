@@ -0,0 +1,119 @@
+#include "BufferPool.h"
+
+#include <stdlib.h>
+#include <new>
+
+// 每个线程自己的空闲块缓存，线程退出时归还给全局链表
+struct BufferThreadCache {
+    static thread_local bool dead;     // 线程缓存已析构（线程退出时其他静态对象里的 Buffer 还可能归还内存）
+
+    char* chunks[BufferPool::CLASS_NUM][BufferPool::THREAD_CACHE_NUM];
+    int cnt[BufferPool::CLASS_NUM] = {0};
+
+    ~BufferThreadCache() {
+        dead = true;
+        for (int i = 0; i < BufferPool::CLASS_NUM; i++) {
+            if (cnt[i] > 0) {
+                BufferPool::Instance()->Return_(i, chunks[i], cnt[i]);
+            }
+        }
+    }
+};
+
+thread_local bool BufferThreadCache::dead = false;
+static thread_local BufferThreadCache threadCache;
+
+static BufferThreadCache* LocalCache() {
+    return BufferThreadCache::dead ? nullptr : &threadCache;
+}
+
+BufferPool* BufferPool::Instance() {
+    // 故意不析构：其他线程退出时还会通过线程缓存往这里归还内存
+    static BufferPool* pool = new BufferPool();
+    return pool;
+}
+
+int BufferPool::SizeClass(size_t size) {
+    if (size > MAX_CHUNK) return -1;
+    int idx = 0;
+    while (ClassSize(idx) < size) idx++;
+    return idx;
+}
+
+char* BufferPool::Allocate(size_t size, size_t* cap) {
+    int idx = SizeClass(size);
+    if (idx < 0) {
+        // 大块按 4K 取整直接向系统申请
+        *cap = (size + 4095) & ~static_cast<size_t>(4095);
+        char* p = static_cast<char*>(malloc(*cap));
+        if (!p) throw std::bad_alloc();
+        return p;
+    }
+    *cap = ClassSize(idx);
+    char* p = nullptr;
+    BufferThreadCache* cache = LocalCache();
+    if (cache) {
+        if (cache->cnt[idx] == 0) {
+            cache->cnt[idx] = Fetch_(idx, cache->chunks[idx], BATCH_NUM);
+        }
+        if (cache->cnt[idx] > 0) {
+            return cache->chunks[idx][--cache->cnt[idx]];
+        }
+    }
+    else if (Fetch_(idx, &p, 1) == 1) {
+        return p;
+    }
+    p = static_cast<char*>(malloc(*cap));
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void BufferPool::Deallocate(char* p, size_t cap) {
+    if (!p) return;
+    int idx = SizeClass(cap);
+    if (idx < 0 || ClassSize(idx) != cap) {
+        free(p);
+        return;
+    }
+    BufferThreadCache* cache = LocalCache();
+    if (!cache) {
+        Return_(idx, &p, 1);
+        return;
+    }
+    if (cache->cnt[idx] == THREAD_CACHE_NUM) {
+        // 缓存满了，把最早放进来的一批还给全局链表
+        Return_(idx, cache->chunks[idx], BATCH_NUM);
+        cache->cnt[idx] -= BATCH_NUM;
+        for (int i = 0; i < cache->cnt[idx]; i++) {
+            cache->chunks[idx][i] = cache->chunks[idx][i + BATCH_NUM];
+        }
+    }
+    cache->chunks[idx][cache->cnt[idx]++] = p;
+}
+
+int BufferPool::Fetch_(int idx, char** out, int n) {
+    std::lock_guard<std::mutex> locker(mtx_[idx]);
+    std::vector<char*>& list = free_[idx];
+    int got = 0;
+    while (got < n && !list.empty()) {
+        out[got++] = list.back();
+        list.pop_back();
+    }
+    cachedBytes_.fetch_sub(got * ClassSize(idx), std::memory_order_relaxed);
+    return got;
+}
+
+void BufferPool::Return_(int idx, char** chunks, int n) {
+    size_t maxNum = MAX_RETAIN / ClassSize(idx);
+    std::lock_guard<std::mutex> locker(mtx_[idx]);
+    std::vector<char*>& list = free_[idx];
+    for (int i = 0; i < n; i++) {
+        if (list.size() < maxNum) {
+            list.push_back(chunks[i]);
+            cachedBytes_.fetch_add(ClassSize(idx), std::memory_order_relaxed);
+        }
+        else {
+            free(chunks[i]);
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+#include <atomic>
+
+/*
+ * Buffer 的存储池
+ * 按 1K、2K、4K … 64K 分成 7 个规格，申请时向上取整到某个规格，超过 64K 的直接用 malloc。
+ * 每个线程先在自己的缓存里取还，缓存空了/满了再成批地和全局空闲链表交换，
+ * 全局空闲链表超过上限的部分直接还给系统，不会无限囤积。
+ */
+class BufferPool {
+public:
+    static BufferPool* Instance();
+
+    // 申请至少 size 字节，*cap 返回实际容量
+    char* Allocate(size_t size, size_t* cap);
+    void Deallocate(char* p, size_t cap);
+
+    size_t CachedBytes() const { return cachedBytes_.load(std::memory_order_relaxed); }   // 全局空闲链表中的字节数
+
+    static const size_t MIN_CHUNK = 1024;
+    static const size_t MAX_CHUNK = 64 * 1024;
+    static const int CLASS_NUM = 7;                 // 1K ~ 64K
+    static const int THREAD_CACHE_NUM = 16;         // 每个线程每个规格最多缓存的块数
+    static const int BATCH_NUM = 8;                 // 线程缓存和全局链表之间一次交换的块数
+    static const size_t MAX_RETAIN = 4 * 1024 * 1024;  // 全局链表每个规格最多保留的字节数
+
+    static int SizeClass(size_t size);              // 规格下标，超过 MAX_CHUNK 返回 -1
+    static size_t ClassSize(int idx) { return MIN_CHUNK << idx; }
+
+private:
+    friend struct BufferThreadCache;
+    BufferPool() : cachedBytes_(0) {}
+
+    // 线程缓存和全局链表之间成批交换
+    int Fetch_(int idx, char** out, int n);
+    void Return_(int idx, char** chunks, int n);
+
+    std::mutex mtx_[CLASS_NUM];
+    std::vector<char*> free_[CLASS_NUM];
+    std::atomic<size_t> cachedBytes_;
+};
+
+#endif // BUFFER_POOL_H
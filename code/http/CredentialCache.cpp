@@ -0,0 +1,65 @@
+#include "CredentialCache.h"
+
+#include "../timer/CoarseClock.h"
+
+CredentialCache* CredentialCache::Instance() {
+    static CredentialCache cache;
+    return &cache;
+}
+
+void CredentialCache::Init(size_t capacity, int ttlMs) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    capacity_ = capacity;
+    ttlMs_ = ttlMs;
+    lru_.clear();
+    index_.clear();
+}
+
+bool CredentialCache::Match(const std::string& name, const std::string& pwd) {
+    int64_t now = CoarseClock::NowMs();
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto it = index_.find(name);
+    if (it == index_.end()) return false;
+    LruIter entry = it->second;
+    if (entry->expireMs <= now) {
+        lru_.erase(entry);
+        index_.erase(it);
+        return false;
+    }
+    if (entry->pwd != pwd) return false;
+    lru_.splice(lru_.begin(), lru_, entry);
+    return true;
+}
+
+void CredentialCache::Put(const std::string& name, const std::string& pwd) {
+    int64_t now = CoarseClock::NowMs();
+    std::lock_guard<std::mutex> locker(mtx_);
+    if (capacity_ == 0) return;
+    int64_t expire = now + ttlMs_;
+    auto it = index_.find(name);
+    if (it != index_.end()) {
+        it->second->pwd = pwd;
+        it->second->expireMs = expire;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return;
+    }
+    lru_.push_front({name, pwd, expire});
+    index_[name] = lru_.begin();
+    while (lru_.size() > capacity_) {
+        index_.erase(lru_.back().name);
+        lru_.pop_back();
+    }
+}
+
+void CredentialCache::Invalidate(const std::string& name) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto it = index_.find(name);
+    if (it == index_.end()) return;
+    lru_.erase(it->second);
+    index_.erase(it);
+}
+
+size_t CredentialCache::Size() {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return lru_.size();
+}
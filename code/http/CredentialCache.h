@@ -0,0 +1,46 @@
+#ifndef CREDENTIAL_CACHE_H
+#define CREDENTIAL_CACHE_H
+
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+ * 登录成功过的 用户名 -> 密码 缓存（LRU，按条数限容，带过期时间）
+ * 同一个用户反复登录时直接在内存里比对，不再经过数据库线程；
+ * 只缓存验证通过的结果，密码对不上、过期或者不在缓存里都交给数据库重新验证。
+ * 命中就跳过数据库，所以比对的是完整的密码（数据库里本来也是明文），不用可能碰撞的短摘要。注册时会让同名的条目失效。
+ */
+class CredentialCache {
+public:
+    static CredentialCache* Instance();
+
+    void Init(size_t capacity = 10000, int ttlMs = 60000);     // capacity 为 0 时不缓存
+
+    bool Match(const std::string& name, const std::string& pwd);    // 命中并且密码一致
+    void Put(const std::string& name, const std::string& pwd);      // 数据库验证通过后调用
+    void Invalidate(const std::string& name);
+    size_t Size();
+
+private:
+    struct Entry {
+        std::string name;
+        std::string pwd;
+        int64_t expireMs;
+    };
+    typedef std::list<Entry>::iterator LruIter;
+
+    CredentialCache() = default;
+    ~CredentialCache() = default;
+
+    size_t capacity_ = 10000;
+    int ttlMs_ = 60000;
+
+    std::mutex mtx_;
+    std::list<Entry> lru_;                              // 头部为最近使用
+    std::unordered_map<std::string, LruIter> index_;    // 用户名 -> lru_ 中的位置
+};
+
+#endif // CREDENTIAL_CACHE_H
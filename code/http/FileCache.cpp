@@ -0,0 +1,153 @@
+#include "FileCache.h"
+#include "HttpResponse.h"
+#include "../timer/CoarseClock.h"
+
+FileCache* FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::Init(const std::string& srcDir, size_t capacity, size_t maxFileSize, int revalidateMs) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    srcDir_ = srcDir;
+    capacity_ = capacity;
+    maxFileSize_ = maxFileSize;
+    revalidateMs_ = revalidateMs;
+    lru_.clear();
+    index_.clear();
+    size_ = 0;
+}
+
+// 和定时器共用缓存的粗粒度时钟
+int64_t FileCache::NowMs_() {
+    return CoarseClock::NowMs();
+}
+
+size_t FileCache::Cost_(const CachedFile& file) {
+    return sizeof(CachedFile) + file.path.size() + file.content.size() + file.header.size();
+}
+
+// 文件被删除时 st 全为 0，和存在的文件一定不同
+bool FileCache::SameStat_(const struct stat& a, const struct stat& b) {
+    return a.st_mode == b.st_mode && a.st_mtime == b.st_mtime && a.st_size == b.st_size;
+}
+
+std::shared_ptr<const CachedFile> FileCache::Get(const std::string& path, struct stat* st) {
+    if (capacity_ == 0) {
+        if (stat((srcDir_ + path).data(), st) < 0) *st = { 0 };
+        return nullptr;
+    }
+
+    FilePtr file;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        auto it = index_.find(path);
+        if (it != index_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);    // 移到头部
+            file = *it->second;
+        }
+    }
+
+    int64_t now = NowMs_();
+    if (file) {
+        if (now - file->checkedMs.load(std::memory_order_relaxed) >= revalidateMs_) {
+            // 到了校验周期，stat 一次看文件有没有变化
+            struct stat cur;
+            if (stat((srcDir_ + path).data(), &cur) < 0) cur = { 0 };
+            if (SameStat_(cur, file->st)) {
+                file->checkedMs.store(now, std::memory_order_relaxed);
+            } else {
+                Erase_(path);
+                LOG_DEBUG("FileCache %s changed, reload", path.c_str());
+                file = nullptr;
+            }
+        }
+    }
+    if (!file) {
+        file = Load_(path);
+        if (!file) {
+            *st = { 0 };
+            return nullptr;     // 不存在的路径不缓存，随便构造的 404 请求挤不掉缓存中的文件
+        }
+        file->checkedMs.store(now, std::memory_order_relaxed);
+        Insert_(file);
+    }
+    *st = file->st;
+    if (!file->hasContent) return nullptr;
+    return file;
+}
+
+FileCache::FilePtr FileCache::Load_(const std::string& path) {
+    FilePtr file = std::make_shared<CachedFile>();
+    file->path = path;
+    file->hasContent = false;
+
+    // 先 stat，不存在的返回 nullptr；不可读、是目录或者太大的文件不用打开，只缓存 stat 的结果
+    const struct stat& st = file->st;
+    if (stat((srcDir_ + path).data(), &file->st) < 0) return nullptr;
+    if (!S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH) || static_cast<size_t>(st.st_size) > maxFileSize_) {
+        return file;
+    }
+
+    int fd = open((srcDir_ + path).data(), O_RDONLY);
+    if (fd < 0) return file;
+    file->content.resize(st.st_size);
+    size_t done = 0;
+    while (done < file->content.size()) {
+        ssize_t len = read(fd, &file->content[done], file->content.size() - done);
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) continue;
+            close(fd);
+            std::string().swap(file->content);
+            return file;        // 读的过程中文件被截断了，下次校验时大小对不上会重新加载
+        }
+        done += len;
+    }
+    close(fd);
+
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)st.st_mtime, (unsigned long)st.st_size);
+    file->header = "Content-type: " + HttpResponse::GetFileType(path) + "\r\n"
+                 + "ETag: " + etag + "\r\n"
+                 + "Content-length: " + std::to_string(st.st_size) + "\r\n\r\n";
+    file->hasContent = true;
+    return file;
+}
+
+void FileCache::Insert_(const FilePtr& file) {
+    size_t cost = Cost_(*file);
+    if (cost > capacity_) return;
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto it = index_.find(file->path);
+    if (it != index_.end()) {       // 别的线程已经加载过了，用新的替换
+        size_ -= Cost_(**it->second);
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    lru_.push_front(file);
+    index_[file->path] = lru_.begin();
+    size_ += cost;
+
+    // 淘汰最久未使用的文件，正在发送的连接仍然持有 shared_ptr，不受影响
+    while (size_ > capacity_ && !lru_.empty()) {
+        const FilePtr& victim = lru_.back();
+        size_ -= Cost_(*victim);
+        index_.erase(victim->path);
+        lru_.pop_back();
+    }
+}
+
+void FileCache::Erase_(const std::string& path) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto it = index_.find(path);
+    if (it == index_.end()) return;
+    size_ -= Cost_(**it->second);
+    lru_.erase(it->second);
+    index_.erase(it);
+}
+
+size_t FileCache::Size() {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return size_;
+}
@@ -0,0 +1,71 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// 缓存中的一个文件：内容和响应头在加载时一次生成，之后只读，可以被多个连接同时引用
+// 不可读、是目录或者太大的文件只缓存 stat 的结果，同样按 revalidateMs 校验，免得每次请求都 stat/open 一次；
+// 不存在的路径不缓存，否则随便构造的 404 请求就能把缓存中的文件挤出去
+struct CachedFile {
+    std::string path;               // 相对资源目录的路径，也是缓存的键
+    std::string content;            // 文件内容
+    std::string header;             // 预先生成的 Content-type / Content-length / ETag 响应头，以空行结尾
+    struct stat st;                 // 加载时文件的状态
+    bool hasContent;                // 内容是否在缓存中，为 false 时只有 st 有效
+    std::atomic<int64_t> checkedMs; // 上次 stat 校验的时间
+};
+
+/*
+ * 进程内共享的静态文件缓存（LRU，按总字节数限容）。
+ * 命中时不需要 stat/open/mmap，只有距离上次校验超过 revalidateMs 才会 stat 一次，
+ * 发现文件被修改就重新加载，被删除就移出缓存。
+ */
+class FileCache {
+public:
+    static FileCache* Instance();
+
+    void Init(const std::string& srcDir, size_t capacity = 64 << 20,
+              size_t maxFileSize = 256 << 10, int revalidateMs = 1000);
+
+    // 返回 nullptr 表示内容没有缓存（文件不存在、不可读、是目录或者太大），调用者走原来的路径；
+    // 无论是否返回内容，st 都填上文件的状态（不存在时全为 0），调用者不需要再 stat
+    std::shared_ptr<const CachedFile> Get(const std::string& path, struct stat* st);
+
+    size_t Size();          // 当前缓存的总字节数
+
+private:
+    typedef std::shared_ptr<CachedFile> FilePtr;
+    typedef std::list<FilePtr>::iterator LruIter;
+
+    FileCache() = default;
+    ~FileCache() = default;
+
+    FilePtr Load_(const std::string& path);         // stat 文件，能缓存的再读入并生成响应头，不存在返回 nullptr
+    void Insert_(const FilePtr& file);              // 放入缓存并淘汰最久未使用的文件
+    void Erase_(const std::string& path);
+    static int64_t NowMs_();
+    static size_t Cost_(const CachedFile& file);    // 条目占用的字节数，只有 stat 结果的条目也要算
+    static bool SameStat_(const struct stat& a, const struct stat& b);
+
+    std::string srcDir_;
+    size_t capacity_ = 0;       // 0 表示不缓存
+    size_t maxFileSize_ = 0;
+    int revalidateMs_ = 1000;
+
+    std::mutex mtx_;
+    size_t size_ = 0;
+    std::list<FilePtr> lru_;                            // 头部为最近使用
+    std::unordered_map<std::string, LruIter> index_;    // 路径 -> lru_ 中的位置
+};
+
+#endif // FILE_CACHE_H
@@ -3,11 +3,23 @@
 const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
 bool HttpConn::isET;
+const char* HttpConn::metricsPath = "/__metrics";
 
 HttpConn::HttpConn() {
     fd_ = -1;
     addr_ = {0};
     isClose_ = true;
+    iovCnt_ = iovIdx_ = 0;
+    toWriteBytes_ = 0;
+    resCnt_ = 0;
+    pipe_[0] = pipe_[1] = -1;
+    pipeLen_ = 0;
+    readNs_ = 0;
+    traceId_ = 0;
+    traceStart_ = 0;
+    traceFirstByte_ = false;
+    verifyState_ = VERIFY_NONE;
+    verifyLogin_ = verifyKeepAlive_ = false;
 }
 
 HttpConn::~HttpConn() {
@@ -21,16 +33,32 @@ void HttpConn::init(int sockFd, const sockaddr_in& addr) {
     fd_ = sockFd;
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
+    request_.Init();
+    ReleaseResponses_();
+    verifyState_ = VERIFY_NONE;
+    readNs_ = 0;
+    traceId_ = 0;
+    pipeLen_ = 0;
     isClose_ = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", sockFd, GetIP(), GetPort(), (int)userCount);
 }
 
 void HttpConn::Close() {
-    response_.UnmapFile();
+    if (traceId_) TraceEnd_();
+    ReleaseResponses_();
+    verifyState_ = VERIFY_NONE;     // 还在等的数据库结果回来后会发现连接已经关闭
+    readBuff_.Release();
+    writeBuff_.Release();
     if (isClose_ == false) {
         isClose_ = true;
         userCount--;
         close(fd_);
+        if (pipe_[0] >= 0) {
+            close(pipe_[0]);
+            close(pipe_[1]);
+            pipe_[0] = pipe_[1] = -1;
+            pipeLen_ = 0;       // 关闭时管道里可能还有没发完的数据，槽位复用后不能再算上它们
+        }
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
     }
 }
@@ -54,80 +82,313 @@ int HttpConn::GetPort() const {
 // 从套接字文件描述符中读取数据到读缓冲区
 ssize_t HttpConn::read(int* saveErrno) {
     ssize_t len = -1;
+    uint64_t traceBegin = traceId_ ? Tracer::Now() : 0;
     do {
         // 如果发生错误，会将错误码保存在 saveErrno 指向的地址中
         len = readBuff_.ReadFd(fd_, saveErrno);
         if (len <= 0) {
             break;
         }
+        Metrics::Add(M_BYTES_IN, len);
+        if (readNs_ == 0) readNs_ = Metrics::NowNs();
     } while (isET);     // ET:边沿触发要一次性全部读出
+    if (traceId_) Tracer::Record(T_READ, traceId_, traceBegin, Tracer::Now());
     return len;
 }
 
 // 从 iovec 数组中指定的缓冲区依次写入数据到文件描述符 fd_ 中
+// 连续的内存段合并成一次 writev，文件段用 sendfile 零拷贝发送
 ssize_t HttpConn::write(int* saveErrno) {
     ssize_t len = -1;
     do {
-        // 将 iovec 数组中指定的所有缓冲区的内容依次写入到文件描述符 fd 中
-        len = writev(fd_, iov_, iovCnt_);
+        uint64_t traceBegin = traceId_ ? Tracer::Now() : 0;
+        if (iovIdx_ < iovCnt_ && iovFd_[iovIdx_] >= 0) {
+            len = SendFile_();
+        }
+        else {
+            int end = iovIdx_;
+            while (end < iovCnt_ && iovFd_[end] < 0) end++;
+            // 将 iovec 数组中还没写完的缓冲区的内容依次写入到文件描述符 fd 中
+            len = writev(fd_, iov_ + iovIdx_, end - iovIdx_);
+        }
+        if (traceId_) Tracer::Record(T_WRITE, traceId_, traceBegin, Tracer::Now());
         if (len < 0) {
             *saveErrno = errno;
             break;
         }
-        if (iov_[0].iov_len + iov_[1].iov_len == 0) break;
-        else if (static_cast<size_t>(len) > iov_[0].iov_len) {
-            // 如果写入的字节数超过了第一个缓冲区的大小
-            // 调整第二个缓冲区的位置和大小
-            iov_[1].iov_base = (uint8_t*)iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            // 如果第一个缓冲区还有剩余数据，则清空写缓冲区
-            // 并且将第一个缓冲区的长度设为0
-            if (iov_[0].iov_len) {
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
-            }
+        Sent(len);
+        if (toWriteBytes_ == 0) break;
+    }while (isET || ToWriteBytes() > 10240); // 如果启用了 ET 模式，或者待写入的字节数大于 10240，则继续写入
+    return len;
+}
+
+// 已经发出 len 字节：跳过写完的段，写了一部分的那个调整起始位置和长度（文件段的偏移已经由 sendfile 更新）
+void HttpConn::Sent(size_t len) {
+    if (traceId_ && len > 0 && !traceFirstByte_) {
+        Tracer::Mark(T_FIRST_BYTE, traceId_);
+        traceFirstByte_ = true;
+    }
+    toWriteBytes_ -= len;
+    Metrics::Add(M_BYTES_OUT, len);
+    size_t left = len;
+    while (left > 0 && iovIdx_ < iovCnt_) {
+        if (left >= iov_[iovIdx_].iov_len) {
+            left -= iov_[iovIdx_].iov_len;
+            iov_[iovIdx_].iov_len = 0;
+            iovIdx_++;
         }
         else {
-            // 如果写入的字节数未超过第一个缓冲区的大小
-            // 调整第一个缓冲区的位置和大小，并从写缓冲区中移除已写入的数据
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len;
-            iov_[0].iov_len -= len;
-            writeBuff_.Retrieve(len);
+            if (iovFd_[iovIdx_] < 0) {
+                iov_[iovIdx_].iov_base = (uint8_t*)iov_[iovIdx_].iov_base + left;
+            }
+            iov_[iovIdx_].iov_len -= left;
+            left = 0;
         }
-    }while (isET || ToWriteBytes() > 10240); // 如果启用了 ET 模式，或者待写入的字节数大于 10240，则继续写入
-    return len;
+    }
+    if (toWriteBytes_ == 0) {
+        // 这一批响应发完了；还有挂起的验证或者读缓冲区里还有下一批的数据时，从现在开始算它们的延迟
+        int64_t now = Metrics::NowNs();
+        if (readNs_ > 0) Metrics::Record(H_REQUEST, now - readNs_, resCnt_);
+        readNs_ = (verifyState_ != VERIFY_NONE || readBuff_.ReadableBytes() > 0) ? now : 0;
+        // 还在等数据库的登录/注册要等它的响应发完才算结束
+        if (traceId_ && verifyState_ == VERIFY_NONE) {
+            Tracer::Mark(T_LAST_BYTE, traceId_);
+            TraceEnd_();
+        }
+    }
 }
 
-bool HttpConn::process() {
-    request_.Init();
-    if (readBuff_.ReadableBytes() <= 0)     // 如果读缓冲区中没有数据可读，返回false
-        return false;
-    else if (request_.Parse(readBuff_)) {   // 解析HTTP请求
-        LOG_DEBUG("%s", request_.Path().c_str());   // 记录请求的路径信息
-        // 初始化HttpResponse对象，设置响应报文状态码为200
-        response_.Init(srcDir, request_.Path(), request_.IsKeepAlive(), 200);
+int HttpConn::PendingIov(struct iovec** iov) {
+    int end = iovIdx_;
+    while (end < iovCnt_ && iovFd_[end] < 0) end++;
+    *iov = iov_ + iovIdx_;
+    return end - iovIdx_;
+}
+
+void HttpConn::AppendRead(const char* data, size_t len) {
+    readBuff_.Append(data, len);
+    Metrics::Add(M_BYTES_IN, len);
+    if (readNs_ == 0) readNs_ = Metrics::NowNs();
+}
+
+ssize_t HttpConn::SendFile_() {
+    if (pipe_[0] < 0) {
+        ssize_t len = sendfile(fd_, iovFd_[iovIdx_], &fileOff_[iovIdx_], iov_[iovIdx_].iov_len);
+        if (len == 0) {         // 文件在发送过程中被截断了，没法按 Content-length 发完
+            errno = EIO;
+            return -1;
+        }
+        // 部分文件系统不支持 sendfile，退回到 splice
+        if (len > 0 || (errno != EINVAL && errno != ENOSYS)) {
+            return len;
+        }
+        if (pipe2(pipe_, O_NONBLOCK) < 0) {
+            pipe_[0] = pipe_[1] = -1;
+            return -1;
+        }
+        LOG_WARN("Client[%d] sendfile unsupported, fall back to splice", fd_);
+    }
+    return SpliceFile_();
+}
+
+// 文件 -> 管道 -> 套接字，数据始终留在内核中；套接字写满时管道里可能残留数据，下次先把它发完
+ssize_t HttpConn::SpliceFile_() {
+    size_t remain = iov_[iovIdx_].iov_len;
+    if (pipeLen_ < remain) {
+        ssize_t in = splice(iovFd_[iovIdx_], &fileOff_[iovIdx_], pipe_[1], nullptr,
+                            remain - pipeLen_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (in < 0 && errno != EAGAIN) return -1;   // 管道满时返回 EAGAIN，先把管道里的发出去
+        if (in == 0 && pipeLen_ == 0) {             // 文件被截断
+            errno = EIO;
+            return -1;
+        }
+        if (in > 0) pipeLen_ += in;
+    }
+    if (pipeLen_ == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    ssize_t out = splice(pipe_[0], nullptr, fd_, nullptr, pipeLen_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (out > 0) pipeLen_ -= out;
+    return out;
+}
+
+void HttpConn::AddIov_(const char* base, size_t len) {
+    if (len == 0) return;
+    if (iovCnt_ > 0 && iovFd_[iovCnt_ - 1] < 0
+            && (const char*)iov_[iovCnt_ - 1].iov_base + iov_[iovCnt_ - 1].iov_len == base) {
+        iov_[iovCnt_ - 1].iov_len += len;
     }
     else {
-        // 如果解析失败，初始化HttpResponse对象，设置响应报文状态码为400
-        response_.Init(srcDir, request_.Path(), false, 400);
+        assert(iovCnt_ < 2 * MAX_PIPELINE);
+        iov_[iovCnt_].iov_base = const_cast<char*>(base);
+        iov_[iovCnt_].iov_len = len;
+        iovFd_[iovCnt_] = -1;
+        iovCnt_++;
     }
+    toWriteBytes_ += len;
+}
 
-    response_.MakeResponse(writeBuff_);         // 生成响应报文放入writeBuff_中
-    // 设置第一个iovec结构体的基址和长度为写缓冲区中的数据
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
-    iovCnt_ = 1;    // 设置iovec数组的元素个数为1
+void HttpConn::AddFile_(int fileFd, size_t len) {
+    if (len == 0) return;
+    assert(iovCnt_ < 2 * MAX_PIPELINE);
+    iov_[iovCnt_].iov_base = nullptr;
+    iov_[iovCnt_].iov_len = len;
+    iovFd_[iovCnt_] = fileFd;
+    fileOff_[iovCnt_] = 0;
+    iovCnt_++;
+    toWriteBytes_ += len;
+}
 
+void HttpConn::ReleaseResponses_() {
+    for (int i = 0; i < resCnt_; i++) {
+        response_[i].UnmapFile();
+    }
+    resCnt_ = 0;
+    iovCnt_ = iovIdx_ = 0;
+    toWriteBytes_ = 0;
+    writeBuff_.RetrieveAll();
+}
+
+bool HttpConn::MakeResponse_(size_t* headLen) {
+    HttpResponse& response = response_[resCnt_];
+    size_t before = writeBuff_.ReadableBytes();
+    response.MakeResponse(writeBuff_);         // 生成响应报文放入writeBuff_中
+    headLen[resCnt_++] = writeBuff_.ReadableBytes() - before;
+    Metrics::Add(M_REQUESTS);
+    if (response.Code() >= 500) Metrics::Add(M_RESP_5XX);
+    else if (response.Code() >= 400) Metrics::Add(M_RESP_4XX);
+    return response.IsKeepAlive();
+}
+
+void HttpConn::TraceDispatch(const TraceStamp& stamp, bool isRead) {
+    uint64_t now = Tracer::Now();
+    if (traceId_ == 0) {
+        if (!isRead || (traceId_ = Tracer::Sample()) == 0) return;
+        traceStart_ = stamp.wake ? stamp.wake : now;
+        traceFirstByte_ = false;
+    }
+    if (stamp.wake) Tracer::Record(T_DISPATCH, traceId_, stamp.wake, stamp.enqueue ? stamp.enqueue : now);
+    if (stamp.enqueue) Tracer::Record(T_QUEUE, traceId_, stamp.enqueue, now);
+}
 
-    // 如果响应中包含文件内容且文件长度大于0
-    if (response_.FileLen() > 0 && response_.File()) {
-        // 设置第二个iovec结构体的基址和长度为文件内容
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iovCnt_ = 2;        // 设置iovec数组的元素个数为2
+void HttpConn::TraceEnd_() {
+    Tracer::Record(T_REQUEST, traceId_, traceStart_, Tracer::Now());
+    traceId_ = 0;
+}
+
+bool HttpConn::TakeVerify(std::string* name, std::string* pwd, bool* isLogin) {
+    if (verifyState_ != VERIFY_READY) return false;
+    verifyState_ = VERIFY_WAITING;
+    *name = verifyName_;
+    *pwd = verifyPwd_;
+    *isLogin = verifyLogin_;
+    return true;
+}
+
+void HttpConn::SetVerifyResult(bool ok) {
+    if (verifyState_ != VERIFY_WAITING) return;
+    verifyPath_ = ok ? "/welcome.html" : "/error.html";
+    verifyPwd_.clear();
+    verifyState_ = VERIFY_DONE;
+}
+
+// 解析读缓冲区中所有完整的请求（HTTP/1.1 流水线），把它们的响应合并成一次 writev 发送
+// 只有上一批响应发送完之后才会调用，返回 false 表示没有完整的请求，需要继续读（或者在等数据库验证）
+bool HttpConn::process() {
+    ReleaseResponses_();
+    size_t headLen[MAX_PIPELINE];   // 每个响应的响应头在写缓冲区中的长度
+    bool keepAlive = true;
+
+    if (verifyState_ == VERIFY_DONE) {
+        // 验证完的登录/注册请求排在读缓冲区里后续请求的前面
+        verifyState_ = VERIFY_NONE;
+        LOG_DEBUG("%s", verifyPath_.c_str());
+        response_[resCnt_].Init(srcDir, verifyPath_, verifyKeepAlive_, 200);
+        uint64_t traceBegin = traceId_ ? Tracer::Now() : 0;
+        keepAlive = MakeResponse_(headLen);
+        if (traceId_) Tracer::Record(T_BUILD, traceId_, traceBegin, Tracer::Now());
+    }
+
+    // 解析和生成响应的耗时：相邻的时间戳首尾相接，每个请求只多取两次时间
+    int64_t stamp = Metrics::NowNs();
+    uint64_t traceStamp = traceId_ ? Tracer::Now() : 0;
+    while (keepAlive && verifyState_ == VERIFY_NONE && resCnt_ < MAX_PIPELINE && readBuff_.ReadableBytes() > 0) {
+        HttpRequest::HTTP_CODE ret = request_.Parse(readBuff_);    // 解析HTTP请求
+        if (ret == HttpRequest::NO_REQUEST) {
+            break;          // 请求还不完整，保留解析状态，等后续数据到达
+        }
+        int64_t parsed = Metrics::NowNs();
+        Metrics::Record(H_PARSE, parsed - stamp);
+        if (traceId_) {
+            uint64_t now = Tracer::Now();
+            Tracer::Record(T_PARSE, traceId_, traceStamp, now);
+            traceStamp = now;
+        }
+
+        if (ret == HttpRequest::GET_REQUEST && request_.NeedVerify()) {
+            // 要查数据库，挂起这个请求：这一批先发前面的响应，后面的请求等验证完再处理，保证响应顺序
+            verifyName_ = request_.GetPost("username");
+            verifyPwd_ = request_.GetPost("password");
+            verifyLogin_ = request_.IsLogin();
+            verifyKeepAlive_ = request_.IsKeepAlive();
+            verifyState_ = VERIFY_READY;
+            readBuff_.Retrieve(request_.RequestLen());
+            request_.Init();
+            break;
+        }
+
+        HttpResponse& response = response_[resCnt_];
+        if (ret == HttpRequest::GET_REQUEST && request_.Path() == metricsPath) {
+            response.InitBody(Metrics::Instance()->Render(), "text/plain; version=0.0.4", request_.IsKeepAlive());
+            readBuff_.Retrieve(request_.RequestLen());
+        }
+        else if (ret == HttpRequest::GET_REQUEST) {
+            LOG_DEBUG("%s", request_.Path().c_str());   // 记录请求的路径信息
+            // 初始化HttpResponse对象，设置响应报文状态码为200
+            response.Init(srcDir, request_.Path(), request_.IsKeepAlive(), 200);
+            readBuff_.Retrieve(request_.RequestLen());  // 请求已经处理完，从读缓冲区中移除
+        }
+        else {
+            // 如果解析失败，初始化HttpResponse对象，设置响应报文状态码为400
+            response.Init(srcDir, request_.Path(), false, 400);
+            readBuff_.RetrieveAll();
+        }
+        request_.Init();    // 为下一个请求重置解析状态
+
+        keepAlive = MakeResponse_(headLen);     // 连接发送完就要关闭，后面的请求不再处理
+        stamp = Metrics::NowNs();
+        Metrics::Record(H_BUILD, stamp - parsed);
+        if (traceId_) {
+            uint64_t now = Tracer::Now();
+            Tracer::Record(T_BUILD, traceId_, traceStamp, now);
+            traceStamp = now;
+        }
+    }
+    if (resCnt_ == 0) {
+        // 连接空闲了（没有未发完的响应，也没有半个请求），把缓冲区的内存还给 BufferPool
+        writeBuff_.Release();
+        if (readBuff_.ReadableBytes() == 0) {
+            readBuff_.Release();
+        }
+        return false;
+    }
+
+    // 写缓冲区在生成响应的过程中可能扩容，所以等全部生成完再按顺序填 iovec：
+    // 响应头（写缓冲区）+ 文件内容，相邻的响应头（例如中间的响应没有文件）会合并成一段
+    const char* head = writeBuff_.Peek();
+    for (int i = 0; i < resCnt_; i++) {
+        AddIov_(head, headLen[i]);
+        head += headLen[i];
+        if (response_[i].FileLen() > 0 && response_[i].File()) {
+            AddIov_(response_[i].File(), response_[i].FileLen());
+        }
+        else if (response_[i].FileLen() > 0 && response_[i].FileFd() >= 0) {
+            AddFile_(response_[i].FileFd(), response_[i].FileLen());
+        }
     }
 
-    // 记录文件大小、iovec数组元素个数和待写入字节数
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen(), iovCnt_, ToWriteBytes());
+    // 记录响应个数、iovec数组元素个数和待写入字节数
+    LOG_DEBUG("responses:%d, %d  to %d", resCnt_, iovCnt_, ToWriteBytes());
     return true;
 }
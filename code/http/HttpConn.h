@@ -3,11 +3,15 @@
 
 #include <sys/types.h>
 #include <sys/uio.h>        // readv / writev
+#include <sys/sendfile.h>   // sendfile
+#include <fcntl.h>          // splice
 #include <arpa/inet.h>      // sockaddr_in
 #include <stdlib.h>         // atoi
 #include <errno.h>
 
 #include "../log/Log.h"
+#include "../log/Metrics.h"
+#include "../log/Trace.h"
 #include "../buffer/Buffer.h"
 #include "HttpRequest.h"
 #include "HttpResponse.h"
@@ -28,32 +32,96 @@ public:
     sockaddr_in GetAddr() const;
     bool process();
 
+    bool IsClose() const {
+        return isClose_;
+    }
+
+    // 登录/注册请求在等数据库验证：process() 遇到这种请求时把它挂起，前面的响应照常发送，
+    // 连接空闲后由服务器用 TakeVerify() 取出交给 DbExecutor，结果用 SetVerifyResult() 交回来，再 process() 生成响应
+    bool IsVerifying() const {
+        return verifyState_ == VERIFY_READY || verifyState_ == VERIFY_WAITING;
+    }
+    bool TakeVerify(std::string* name, std::string* pwd, bool* isLogin);   // 只在第一次调用时返回 true
+    void SetVerifyResult(bool ok);
+
+    // 追踪（Tracer::Enabled() 时才调用）：处理读写事件前记录事件循环和线程池里的等待，
+    // 读事件上没有在追踪的连接按比例抽样开始追踪，写事件只记录已经在追踪的
+    void TraceDispatch(const TraceStamp& stamp, bool isRead);
+    uint32_t TraceId() const { return traceId_; }
+
+    // io_uring 后端不调用 read()/write()：收到的数据用 AppendRead 放进读缓冲区；
+    // 发送时用 PendingIov 取出从当前位置开始连续的内存段（遇到文件段为止），发出后用 Sent 告知字节数
+    void AppendRead(const char* data, size_t len);
+    size_t ReadBytes() const { return readBuff_.ReadableBytes(); }     // 读缓冲区里还没处理的字节数
+    int PendingIov(struct iovec** iov);
+    void Sent(size_t len);
+
     int ToWriteBytes() {
-        return iov_[0].iov_len + iov_[1].iov_len;
+        return static_cast<int>(toWriteBytes_);
     }
 
+    // 以这一批中最后一个响应为准，中间出现非持久连接的请求时批次会在它之后截止
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        return resCnt_ > 0 && response_[resCnt_ - 1].IsKeepAlive();
     }
 
     static bool isET;
     static const char* srcDir;
     static std::atomic<int> userCount;
 
+    static const int MAX_PIPELINE = 8;     // 一次 writev 最多合并的流水线响应数
+    static const char* metricsPath;         // 这个路径返回运行时指标（Prometheus 文本格式），不对应文件
+
 private:
+    void AddIov_(const char* base, size_t len);     // 追加一段待发送的内存数据，和上一段相邻时直接合并
+    void AddFile_(int fileFd, size_t len);          // 追加一段用 sendfile 发送的文件
+    void ReleaseResponses_();                       // 释放上一批响应占用的文件和写缓冲区
+    bool MakeResponse_(size_t* headLen);            // 生成 response_[resCnt_] 的响应报文，返回是否保持连接
+    ssize_t SendFile_();                            // 发送 iovIdx_ 处的文件段
+    ssize_t SpliceFile_();                          // sendfile 不可用时，经管道用 splice 发送
+
     int fd_;
     struct sockaddr_in addr_;
 
     bool isClose_;
 
     int iovCnt_;
-    struct iovec iov_[2];
+    int iovIdx_;            // 第一个还没写完的 iovec
+    size_t toWriteBytes_;   // 还没写完的字节数
+    struct iovec iov_[2 * MAX_PIPELINE];    // 每个响应：响应头（写缓冲区）+ 文件内容
+    // 零拷贝模式下文件内容不在内存中：iovFd_ >= 0 的段用 sendfile 发送，iov_len 为剩余长度，
+    // fileOff_ 为文件中的发送偏移，遇到 EAGAIN 时保留，下次从这里继续
+    int iovFd_[2 * MAX_PIPELINE];
+    off_t fileOff_[2 * MAX_PIPELINE];
+
+    int pipe_[2];           // splice 用的管道，只在 sendfile 不可用时创建
+    size_t pipeLen_;        // 已经从文件进入管道、还没写到套接字的字节数
+
+    int64_t readNs_;        // 这一批请求的数据开始到达的时间，响应全部发完时记录请求延迟，0 表示还没有
+
+    uint32_t traceId_;      // 正在追踪的请求编号，0 表示没有
+    uint64_t traceStart_;   // 追踪开始的时间（Tracer::Now）
+    bool traceFirstByte_;   // 第一个字节是否已经发出
+    void TraceEnd_();
 
     Buffer readBuff_;       // 读缓冲区
     Buffer writeBuff_;      // 写缓冲区
 
+    enum VerifyState {
+        VERIFY_NONE,        // 没有挂起的登录/注册请求
+        VERIFY_READY,       // 解析出来了，还没提交给数据库线程
+        VERIFY_WAITING,     // 已经提交，等结果
+        VERIFY_DONE,        // 结果出来了，下一次 process() 先生成它的响应
+    };
+    VerifyState verifyState_;
+    bool verifyLogin_;
+    bool verifyKeepAlive_;
+    std::string verifyName_, verifyPwd_;
+    std::string verifyPath_;    // 验证结果对应的页面
+
     HttpRequest request_;
-    HttpResponse response_;
+    int resCnt_;            // 本批次的响应数
+    HttpResponse response_[MAX_PIPELINE];
 };
 
 #endif // HTTPCONN_H
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "HttpRequest.h"
+#include "CredentialCache.h"
+
+#include <algorithm>
 
 
 // 网页名称，和一般的前端跳转不同，这里需要将请求信息放到后端来验证一遍再上传
@@ -14,66 +17,89 @@ const std::unordered_map<std::string, int> HttpRequest::DEFAULT_HTML_TAG {
 // 初始化，清零
 void HttpRequest::Init() {
     state_ = REQUEST_LINE;
-    method_ = path_ = version_ = body_ = "";
-    header_.clear();
+    base_ = nullptr;
+    parsedLen_ = scanLen_ = 0;
+    method_ = version_ = {0, 0};
+    path_.clear();      // clear() 保留已分配的容量，同一连接上的后续请求不再分配内存
+    body_.clear();
+    headerCnt_ = 0;
+    contentLen_ = 0;
+    isKeepAlive_ = false;
+    isUrlEncoded_ = false;
+    verifyTag_ = -1;
     post_.clear();
 }
 
-// 解析处理
-bool HttpRequest::Parse(Buffer& buff) {
-    const char END[] = "\r\n";
+// 解析处理：按行推进的状态机，直接在缓冲区的字节上工作，不拷贝行
+HttpRequest::HTTP_CODE HttpRequest::Parse(const Buffer& buff) {
+    // 缓冲区可能在两次 Parse 之间扩容或腾挪，所以每次都重新取起始地址，已解析的部分只记偏移
+    base_ = buff.Peek();
+    const size_t readable = buff.ReadableBytes();
+
+    while (state_ != FINISH) {
+        if (state_ == BODY) {
+            if (readable - parsedLen_ < contentLen_) return NO_REQUEST;     // 请求体还没收全
+            ParseBody_(base_ + parsedLen_, contentLen_);
+            parsedLen_ += contentLen_;
+            break;
+        }
 
-    // 没有可读的字节
-    if (buff.ReadableBytes() <= 0) return false;
+        // 从上次扫描结束的位置继续找换行符，找不到说明这一行还没收全
+        const char* lineBegin = base_ + parsedLen_;
+        const char* lf = static_cast<const char*>(memchr(base_ + scanLen_, '\n', readable - scanLen_));
+        if (!lf) {
+            scanLen_ = readable;
+            if (readable > MAX_HEAD_LEN) {
+                LOG_ERROR("Request head too long");
+                return BAD_REQUEST;
+            }
+            return NO_REQUEST;
+        }
+        // 请求行和请求头按完整的行计算总长度，不停发送短的首部行也会超限
+        if (static_cast<size_t>(lf + 1 - base_) > MAX_HEAD_LEN) {
+            LOG_ERROR("Request head too long");
+            return BAD_REQUEST;
+        }
+        const char* lineEnd = (lf > lineBegin && *(lf - 1) == '\r') ? lf - 1 : lf;    // 去掉\r\n
 
-    while (buff.ReadableBytes() && state_ != FINISH) {
-        // 从buff中的读指针开始到读指针结束，这块区域是未读的，找到\r\n，返回其第一次出现的位置，即去掉\r\n的最后一位
-        const char* line_end = std::search(buff.Peek(), buff.BeginWriteConst(), END, END + 2);
-        std::string line(buff.Peek(), line_end);
         switch (state_) {
             case REQUEST_LINE: {
-                if (!ParseRequestLine_(line)) return false; // 解析错误
+                if (!ParseRequestLine_(lineBegin, lineEnd)) return BAD_REQUEST; // 解析错误
                 ParsePath_();   // 解析路径
+                state_ = HEADERS;
                 break;
             }                
             case HEADERS: {
-                ParseHeader_(line); // 解析头部
-                if (buff.ReadableBytes() <= 2) state_ = FINISH;     // 说明是get请求，后面为\r\n，提前结束
+                if (lineBegin == lineEnd) {     // 空行，首部结束，有请求体则继续解析请求体
+                    state_ = contentLen_ > 0 ? BODY : FINISH;
+                }
+                else if (!ParseHeader_(lineBegin, lineEnd)) {
+                    return BAD_REQUEST;
+                }
                 break;
             }            
-            case BODY: {
-                ParseBody_(line);   // 解析请求体
-                break;
-            }
             default:
                 break;
         }
-
-        // 如果找到了缓冲区的末尾，则清空缓冲区并跳出循环
-        if (line_end == buff.BeginWrite()) {
-            buff.RetrieveAll();
-            break;
-        }
-
-        // 将缓冲区中已处理的数据移出，包括\r\n
-        buff.RetrieveUntil(line_end + 2);    
+        parsedLen_ = scanLen_ = lf + 1 - base_;
     }
     // 记录解析结果
-    LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-    return true;
+    LOG_DEBUG("[%s], [%s], [%s]", Method().c_str(), path_.c_str(), Version().c_str());
+    return GET_REQUEST;
 }
 
-// 解析传入的字符串 line，提取出其中的请求方法、路径和 HTTP 版本
-bool HttpRequest::ParseRequestLine_(const std::string& line) {
-    std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    std::smatch Match;      // 用来匹配patten得到结果
-
-    // 在匹配规则中，以括号()的方式来划分组别 一共三个括号 [0]表示整体，[1]表示第一个括号，[2]表示第二个括号，[3]表示第三个括号
-    if (std::regex_match(line, Match, patten)) {
-        method_ = Match[1];
-        path_ = Match[2];
-        version_ = Match[3];
-        state_ = HEADERS;
+// 解析请求行 "METHOD PATH HTTP/VERSION"，提取出其中的请求方法、路径和 HTTP 版本
+bool HttpRequest::ParseRequestLine_(const char* begin, const char* end) {
+    const char* sp1 = static_cast<const char*>(memchr(begin, ' ', end - begin));
+    const char* sp2 = sp1 ? static_cast<const char*>(memchr(sp1 + 1, ' ', end - sp1 - 1)) : nullptr;
+    if (sp1 && sp2 && sp1 > begin && sp2 > sp1 + 1
+            && end - sp2 > 6 && memcmp(sp2 + 1, "HTTP/", 5) == 0
+            && !memchr(sp2 + 1, ' ', end - sp2 - 1)) {
+        method_.off = begin - base_;
+        method_.len = sp1 - begin;
+        path_.assign(sp1 + 1, sp2);
+        version_.off = sp2 + 6 - base_;
+        version_.len = end - (sp2 + 6);
         return true;
     }
     LOG_ERROR("RequestLine Error");
@@ -90,20 +116,66 @@ void HttpRequest::ParsePath_() {
     }
 }
 
-void HttpRequest::ParseHeader_(const std::string& line) {
-    std::regex patten("^([^:]*): ?(.*)$");
-    std::smatch Match;
-    if (std::regex_match(line, Match, patten)) {
-        header_[Match[1]] = Match[2];
-    }   // 匹配失败说明首部行匹配完了，状态改变
-    else state_ = BODY;
+// 解析一行 "Key: Value"，并顺带记下后续逻辑关心的几个首部
+bool HttpRequest::ParseHeader_(const char* begin, const char* end) {
+    const char* colon = static_cast<const char*>(memchr(begin, ':', end - begin));
+    if (!colon || colon == begin) {
+        LOG_ERROR("Header Error");
+        return false;
+    }
+    const char* value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    const char* valueEnd = end;
+    while (valueEnd > value && (*(valueEnd - 1) == ' ' || *(valueEnd - 1) == '\t')) valueEnd--;
+
+    size_t keyLen = colon - begin;
+    size_t valueLen = valueEnd - value;
+    // 超过上限的请求头直接拒绝，不能悄悄丢掉后面的 Connection、Content-Length
+    if (headerCnt_ >= MAX_HEADERS) {
+        LOG_ERROR("Too many headers");
+        return false;
+    }
+    header_[headerCnt_++] = {{static_cast<size_t>(begin - base_), keyLen},
+                             {static_cast<size_t>(value - base_), valueLen}};
+
+    if (EqualNoCase_(begin, keyLen, "connection")) {
+        // 只有 HTTP/1.1 且 Connection: keep-alive 才保持连接
+        isKeepAlive_ = EqualNoCase_(value, valueLen, "keep-alive")
+                    && version_.len == 3 && memcmp(base_ + version_.off, "1.1", 3) == 0;
+    }
+    else if (EqualNoCase_(begin, keyLen, "content-type")) {
+        isUrlEncoded_ = EqualNoCase_(value, valueLen, "application/x-www-form-urlencoded");
+    }
+    else if (EqualNoCase_(begin, keyLen, "content-length")) {
+        size_t len = 0;
+        for (const char* p = value; p < valueEnd; p++) {
+            if (*p < '0' || *p > '9' || len > MAX_BODY_LEN) {
+                LOG_ERROR("Content-Length Error");
+                return false;
+            }
+            len = len * 10 + (*p - '0');
+        }
+        if (len > MAX_BODY_LEN) {
+            LOG_ERROR("Content-Length Error");
+            return false;
+        }
+        contentLen_ = len;
+    }
+    return true;
 }
 
-void HttpRequest::ParseBody_(const std::string& line) {
-    body_ = line;
+void HttpRequest::ParseBody_(const char* begin, size_t len) {
+    body_.assign(begin, len);
     ParsePost_();
     state_ = FINISH;
-    LOG_DEBUG("Body: %s, len: %d", line.c_str(), line.size());
+    LOG_DEBUG("Body: %s, len: %d", body_.c_str(), body_.size());
+}
+
+bool HttpRequest::EqualNoCase_(const char* s, size_t len, const char* lower) {
+    for (size_t i = 0; i < len; i++) {
+        if (lower[i] == '\0' || tolower(static_cast<unsigned char>(s[i])) != lower[i]) return false;
+    }
+    return lower[len] == '\0';
 }
 
 // 16进制转化为10进制
@@ -117,19 +189,19 @@ int HttpRequest::ConverHex(char ch) {
 
 // 处理post请求
 void HttpRequest::ParsePost_() {
-    if (method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
+    if (method_.len == 4 && memcmp(base_ + method_.off, "POST", 4) == 0 && isUrlEncoded_) {
         ParseFromUrlEncoded_();     
         if (DEFAULT_HTML_TAG.count(path_)) { // 如果是登录/注册的path
             int tag = DEFAULT_HTML_TAG.find(path_)->second; 
             LOG_DEBUG("Tag:%d", tag);
             if (tag == 0 || tag == 1) {
-                bool isLogin = (tag == 1);  // 为1则是登录
-                if (UserVerify(post_["username"], post_["password"], isLogin)) {
-                    path_ = "/welcome.html";
-                } 
-                else {
+                // 用户名或密码为空，不用查数据库
+                if (GetPost("username").empty() || GetPost("password").empty()) {
                     path_ = "/error.html";
                 }
+                else {
+                    verifyTag_ = tag;       // 为1则是登录，查询交给数据库线程
+                }
             }
         }
     }   
@@ -178,77 +250,97 @@ void HttpRequest::ParseFromUrlEncoded_() {
     }
 }
 
-// 用户验证
-bool HttpRequest::UserVerify(const std::string& name, const std::string& pwd, bool isLogin) {
-    // 如果用户名或密码为空，则直接返回false
-    if(name == "" || pwd == "") { return false; }
+// 登录验证，sql 是数据库线程从连接池取到的连接
+// 用连接上预编译好的语句（SqlConnPool::Init 时创建），用户名和密码作为参数传过去，不再拼接 SQL
+// 注册只走 UserAvailable + RegisterBatcher 一条路，同名的查重由批量写线程兜底
+bool HttpRequest::UserVerify(MYSQL* sql, const std::string& name, const std::string& pwd, bool isLogin) {
+    assert(isLogin);
+    (void)isLogin;
+    bool flag = false;
+    // 如果用户名或密码为空，或者没有可用的数据库连接，则直接返回false
+    if(name == "" || pwd == "" || !sql) { return false; }
 
-    // 记录验证的用户名和密码
-    LOG_INFO("Verify name: %s, password: %s", name.c_str(), pwd.c_str());
+    // 记录验证的用户名
+    LOG_INFO("Verify name: %s", name.c_str());
 
-    // 获取数据库连接
-    MYSQL* sql;
-    SqlConnRAII(&sql, SqlConnPool::Instance());
-    assert(sql);
+    std::string password;
+    int found = QueryPassword_(sql, name, &password);
+    if (found < 0) return false;
 
-    bool flag = false;
-    // unsigned int j = 0;
-    char order[256] = {0};
-    // MYSQL_FIELD* fields = nullptr;
-    MYSQL_RES* res = nullptr;
-
-    // 如果是登录操作，则设置标志位为true
-    if (!isLogin) flag = true;
-    // 构造查询用户及密码的SQL语句
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("%s", order);
-
-    // 执行SQL查询
-    if (mysql_query(sql, order)) {
-        mysql_free_result(res);
+    // 检查密码是否匹配，通过的记进缓存，下次同一用户登录不用再查数据库
+    if (found && pwd == password) {
+        flag = true;
+        CredentialCache::Instance()->Put(name, pwd);
+    }
+    else {
+        LOG_INFO("pwd error!");
+    }
+    LOG_DEBUG("UserVerify %s", flag ? "success!!" : "failed!");
+    return flag;
+}
+
+// 注册前检查用户名是否可用：用户名、密码非空，数据库里还没有这个用户
+bool HttpRequest::UserAvailable(MYSQL* sql, const std::string& name, const std::string& pwd) {
+    if(name == "" || pwd == "" || !sql) { return false; }
+    LOG_INFO("Verify name: %s", name.c_str());
+
+    // 注册会改变这个用户名对应的密码，先让缓存失效
+    CredentialCache::Instance()->Invalidate(name);
+
+    std::string password;
+    int found = QueryPassword_(sql, name, &password);
+    if (found < 0) return false;
+    if (found) {
+        LOG_INFO("user used!");
         return false;
     }
-    // 获取查询结果
-    res = mysql_store_result(sql);   
-    // j = mysql_num_fields(res);           // 获取查询结果中的字段（列）数量   
-    // fields = mysql_fetch_fields(res);    // 获取 MySQL 查询结果中字段（列）的描述信息
-
-    // 遍历查询结果
-    while (MYSQL_ROW row = mysql_fetch_row(res)) {
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        std::string password(row[1]);
-        
-        // 如果是登录操作，检查密码是否匹配
-        if(isLogin) {
-            if(pwd == password) { flag = true; }
-            else {
-                flag = false;
-                LOG_INFO("pwd error!");
-            }
-        } 
-        else {  // 如果是注册操作，检查用户名是否已被使用
-            flag = false; 
-            LOG_INFO("user used!");
-        }
+    LOG_DEBUG("regirster!");
+    return true;
+}
+
+// 查询用户的密码：1 找到，0 没有这个用户，-1 出错
+int HttpRequest::QueryPassword_(MYSQL* sql, const std::string& name, std::string* password) {
+    MYSQL_STMT* stmt = SqlConnPool::Instance()->GetStmt(sql, STMT_QUERY_USER);
+    if (!stmt) {
+        LOG_ERROR("No prepared statement for user query!");
+        return -1;
     }
-    // 释放查询结果
-    mysql_free_result(res);
-
-    // 如果是注册操作且用户名未被使用，则执行插入用户数据的SQL语句
-    if (!isLogin && flag == true) {
-        LOG_DEBUG("regirster!");
-        bzero(order, 256);
-        snprintf(order, 256,"INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG( "%s", order);
-        if (mysql_query(sql, order)) { 
-            LOG_DEBUG( "Insert error!");
-            flag = false; 
-        }
-        flag = true;
+
+    unsigned long nameLen = name.size();
+    MYSQL_BIND param[1];
+    memset(param, 0, sizeof(param));
+    param[0].buffer_type = MYSQL_TYPE_STRING;
+    param[0].buffer = const_cast<char*>(name.data());
+    param[0].buffer_length = nameLen;
+    param[0].length = &nameLen;
+
+    char pwdBuf[256];
+    unsigned long pwdLen = 0;
+    MYSQL_BIND result[1];
+    memset(result, 0, sizeof(result));
+    result[0].buffer_type = MYSQL_TYPE_STRING;
+    result[0].buffer = pwdBuf;
+    result[0].buffer_length = sizeof(pwdBuf);
+    result[0].length = &pwdLen;
+
+    if (mysql_stmt_bind_param(stmt, param) || mysql_stmt_execute(stmt)
+            || mysql_stmt_bind_result(stmt, result) || mysql_stmt_store_result(stmt)) {
+        LOG_ERROR("Query user error: %s", mysql_stmt_error(stmt));
+        mysql_stmt_free_result(stmt);
+        return -1;
     }
-    // SqlConnPool::Instance()->FreeConn(sql);
-    LOG_DEBUG( "UserVerify success!!");
-    return flag;
+    int ret = mysql_stmt_fetch(stmt);
+    int found = 0;
+    if (ret == 0 || ret == MYSQL_DATA_TRUNCATED) {
+        password->assign(pwdBuf, std::min<unsigned long>(pwdLen, sizeof(pwdBuf)));
+        found = 1;
+    }
+    else if (ret != MYSQL_NO_DATA) {
+        LOG_ERROR("Fetch user error: %s", mysql_stmt_error(stmt));
+        found = -1;
+    }
+    mysql_stmt_free_result(stmt);
+    return found;
 }
 
 std::string HttpRequest::Path() const {
@@ -260,11 +352,22 @@ std::string& HttpRequest::Path() {
 }
 
 std::string HttpRequest::Method() const {
-    return method_;
+    return base_ ? std::string(base_ + method_.off, method_.len) : "";
 }
 
 std::string HttpRequest::Version() const {
-    return version_; 
+    return base_ ? std::string(base_ + version_.off, version_.len) : ""; 
+}
+
+std::string HttpRequest::GetHeader(const std::string& key) const {
+    assert(key != "");
+    for (size_t i = 0; i < headerCnt_; i++) {
+        const HeaderField& field = header_[i];
+        if (field.key.len == key.size() && strncasecmp(base_ + field.key.off, key.c_str(), key.size()) == 0) {
+            return std::string(base_ + field.value.off, field.value.len);
+        }
+    }
+    return "";
 }
 
 std::string HttpRequest::GetPost(const std::string& key) const {
@@ -281,8 +384,5 @@ std::string HttpRequest::GetPost(const char* key) const {
 
 // 判断当前请求是否为一个持久连接
 bool HttpRequest::IsKeepAlive() const {
-    if(header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
-    }
-    return false;
+    return isKeepAlive_;
 }
\ No newline at end of file
@@ -2,11 +2,12 @@
 #define HTTP_REQUEST_H
 
 #include <errno.h>
+#include <ctype.h>          // tolower
+#include <strings.h>        // strncasecmp
 #include <mysql/mysql.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
-#include <regex>
 
 #include "../buffer/Buffer.h"
 #include "../log/Log.h"
@@ -21,35 +22,81 @@ public:
         FINISH,
     };
 
+    enum HTTP_CODE {        // 解析结果
+        NO_REQUEST,         // 请求还不完整，需要继续读
+        GET_REQUEST,        // 得到了一个完整的请求
+        BAD_REQUEST,        // 请求报文有误
+    };
+
     HttpRequest() { Init(); }
     ~HttpRequest() = default;
 
     void Init();
-    bool Parse(Buffer& buff);
+    // 增量解析：只扫描上次没有解析过的字节，请求被拆成多次 ReadFd 到达时从上次的位置继续。
+    // 解析过程中不消费 buff，得到完整请求后由调用者 Retrieve(RequestLen()) 
+    HTTP_CODE Parse(const Buffer& buff);
+    size_t RequestLen() const { return parsedLen_; }   // 完整请求（含请求体）在缓冲区中占用的字节数
 
+    // Method()/Version()/GetHeader() 引用读缓冲区中的数据，调用者 Retrieve 之后失效
     std::string Path() const;
     std::string& Path();
     std::string Method() const;
     std::string Version() const;
+    std::string GetHeader(const std::string& key) const;
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
 
     bool IsKeepAlive() const;       // 判断当前请求是否为一个持久连接
 
+    // 登录/注册请求需要查数据库，解析时不再就地查询，由调用者交给 DbExecutor 异步执行 UserVerify，
+    // 结果出来以后再决定跳转到 welcome 还是 error 页面
+    bool NeedVerify() const { return verifyTag_ >= 0; }
+    bool IsLogin() const { return verifyTag_ == 1; }
+    static bool UserVerify(MYSQL* sql, const std::string& name, const std::string& pwd, bool isLogin); // 登录验证（isLogin 必须为 true），在数据库线程上调用
+    // 注册的前一半：检查用户名没被占用，插入交给 RegisterBatcher 批量写入
+    static bool UserAvailable(MYSQL* sql, const std::string& name, const std::string& pwd);
+
 private:
-    bool ParseRequestLine_(const std::string& line);                   // 解析请求行
-    void ParseHeader_(const std::string& line);                        // 解析请求头
-    void ParseBody_(const std::string& line);                          // 解析请求体
+    // 读缓冲区中的一段数据，用相对请求起始位置（buff.Peek()）的偏移表示，
+    // 缓冲区扩容或腾挪（MakeSpace_）之后依然有效
+    struct Span {
+        size_t off;
+        size_t len;
+    };
+
+    struct HeaderField {
+        Span key;
+        Span value;
+    };
+
+    bool ParseRequestLine_(const char* begin, const char* end);        // 解析请求行
+    bool ParseHeader_(const char* begin, const char* end);             // 解析请求头
+    void ParseBody_(const char* begin, size_t len);                    // 解析请求体
 
     void ParsePath_();                                                 // 解析请求路径
     void ParsePost_();                                                 // 解析 POST 请求数据
     void ParseFromUrlEncoded_();                                       // 从url中解析编码
 
-    static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin); // 用户验证
+    static int QueryPassword_(MYSQL* sql, const std::string& name, std::string* password);   // 1 找到，0 没有，-1 出错
+    static bool EqualNoCase_(const char* s, size_t len, const char* lower);  // 忽略大小写比较，lower 为小写常量
+
+    static const size_t MAX_HEADERS = 32;           // 请求头数量的上限，超过返回 400
+    static const size_t MAX_HEAD_LEN = 8192;        // 请求行 + 请求头的最大长度
+    static const size_t MAX_BODY_LEN = 1 << 20;     // 请求体的最大长度
 
     PARSE_STATE state_;                                                 // 当前解析状态
-    std::string method_, path_, version_, body_;                        // 请求方法、路径、HTTP 版本、消息体
-    std::unordered_map<std::string, std::string> header_;               // 请求头键值对
+    const char* base_;                                                  // 最近一次 Parse 时请求的起始地址
+    size_t parsedLen_;                                                  // 已经解析完的字节数
+    size_t scanLen_;                                                    // 已经扫描过（确认没有换行符）的字节数
+
+    Span method_, version_;                                             // 请求方法、HTTP 版本
+    std::string path_, body_;                                           // 请求路径、消息体
+    HeaderField header_[MAX_HEADERS];                                   // 请求头键值对
+    size_t headerCnt_;
+    size_t contentLen_;                                                 // Content-Length
+    bool isKeepAlive_;                                                  // Connection: keep-alive
+    bool isUrlEncoded_;                                                 // Content-Type: application/x-www-form-urlencoded
+    int verifyTag_;                                                     // 待验证的用户操作：-1 无，0 注册，1 登录
     std::unordered_map<std::string, std::string> post_;                 // POST 参数键值对
 
     static const std::unordered_set<std::string> DEFAULT_HTML;          // 默认 HTML 内容
@@ -1,44 +1,50 @@
 #include "HttpResponse.h"
 
-const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_TYPE = {
-    { ".html",  "text/html" },
-    { ".xml",   "text/xml" },
-    { ".xhtml", "application/xhtml+xml" },
-    { ".txt",   "text/plain" },
-    { ".rtf",   "application/rtf" },
-    { ".pdf",   "application/pdf" },
-    { ".word",  "application/nsword" },
-    { ".png",   "image/png" },
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpg",   "video/mpeg" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
+const HttpResponse::MimeEntry HttpResponse::SUFFIX_TYPE[] = {
+    { ".html",  "text/html",                "Content-type: text/html\r\n" },
+    { ".xml",   "text/xml",                 "Content-type: text/xml\r\n" },
+    { ".xhtml", "application/xhtml+xml",    "Content-type: application/xhtml+xml\r\n" },
+    { ".txt",   "text/plain",               "Content-type: text/plain\r\n" },
+    { ".rtf",   "application/rtf",          "Content-type: application/rtf\r\n" },
+    { ".pdf",   "application/pdf",          "Content-type: application/pdf\r\n" },
+    { ".word",  "application/nsword",       "Content-type: application/nsword\r\n" },
+    { ".png",   "image/png",                "Content-type: image/png\r\n" },
+    { ".gif",   "image/gif",                "Content-type: image/gif\r\n" },
+    { ".jpg",   "image/jpeg",               "Content-type: image/jpeg\r\n" },
+    { ".jpeg",  "image/jpeg",               "Content-type: image/jpeg\r\n" },
+    { ".au",    "audio/basic",              "Content-type: audio/basic\r\n" },
+    { ".mpeg",  "video/mpeg",               "Content-type: video/mpeg\r\n" },
+    { ".mpg",   "video/mpeg",               "Content-type: video/mpeg\r\n" },
+    { ".avi",   "video/x-msvideo",          "Content-type: video/x-msvideo\r\n" },
+    { ".gz",    "application/x-gzip",       "Content-type: application/x-gzip\r\n" },
+    { ".tar",   "application/x-tar",        "Content-type: application/x-tar\r\n" },
+    { ".css",   "text/css",                 "Content-type: text/css\r\n" },
+    { ".js",    "text/javascript",          "Content-type: text/javascript\r\n" },
 };
 
-const std::unordered_map<int, std::string> HttpResponse::CODE_STATUS = {
-    { 200, "OK" },
-    { 400, "Bad Request" },
-    { 403, "Forbidden" },
-    { 404, "Not Found" },
+const HttpResponse::MimeEntry HttpResponse::DEFAULT_TYPE = {
+    "", "text/plain", "Content-type: text/plain\r\n"
 };
 
-const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
-    { 400, "/400.html" },
-    { 403, "/403.html" },
-    { 404, "/404.html" },
+const HttpResponse::StatusEntry HttpResponse::CODE_STATUS[] = {
+    { 200, "OK",            "HTTP/1.1 200 OK\r\n",           nullptr },
+    { 400, "Bad Request",   "HTTP/1.1 400 Bad Request\r\n",  "/400.html" },
+    { 403, "Forbidden",     "HTTP/1.1 403 Forbidden\r\n",    "/403.html" },
+    { 404, "Not Found",     "HTTP/1.1 404 Not Found\r\n",    "/404.html" },
 };
 
+const HttpResponse::ByteStr HttpResponse::CONN_KEEP_ALIVE = 
+    "Connection: keep-alive\r\nkeep-alive: max=6, timeout=120\r\n";
+const HttpResponse::ByteStr HttpResponse::CONN_CLOSE = "Connection: close\r\n";
+
+bool HttpResponse::zeroCopy = false;
+
 HttpResponse::HttpResponse() {
     code_ = -1;
     path_ = srcDir_ = "";
     mmFile_ = nullptr;
+    fileFd_ = -1;
+    bodyType_ = nullptr;
     mmFileStat_ = { 0 };
 }
 
@@ -46,20 +52,49 @@ HttpResponse::~HttpResponse() {
     UnmapFile();
 }
 
-void HttpResponse::Init(const std::string& srcDir, std::string& path, bool isKeepAlive, int code) {
-    assert(srcDir != "");
-    if (mmFile_) UnmapFile();
+void HttpResponse::Init(const char* srcDir, std::string& path, bool isKeepAlive, int code) {
+    assert(srcDir && *srcDir);
+    UnmapFile();
     code_ = code;
     isKeepAlive_ = isKeepAlive;
-    path_ = path;
+    path_ = path;           // 赋值会复用已有的容量，同一连接上的后续响应不再分配内存
     srcDir_ = srcDir;
+    bodyType_ = nullptr;
+    mmFile_ = nullptr;
+    mmFileStat_ = { 0 };
+}
+
+void HttpResponse::InitBody(std::string body, const char* contentType, bool isKeepAlive) {
+    UnmapFile();
+    code_ = 200;
+    isKeepAlive_ = isKeepAlive;
+    path_.clear();
+    body_ = std::move(body);
+    bodyType_ = contentType;
     mmFile_ = nullptr;
     mmFileStat_ = { 0 };
 }
 
 void HttpResponse::MakeResponse(Buffer& buff) {
-    // 判断请求的资源文件是否存在或者是否为目录
-    if (stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
+    if (bodyType_) {
+        // 生成的内容：响应头和内容都在缓冲区里，FileLen() 为 0
+        AddStateLine_(buff);
+        const ByteStr& conn = isKeepAlive_ ? CONN_KEEP_ALIVE : CONN_CLOSE;
+        buff.Append(conn.data, conn.len);
+        buff.Append(CoarseClock::HttpDate(), CoarseClock::HTTP_DATE_LEN);
+        buff.Append(std::string("Content-type: ") + bodyType_ + "\r\n");
+        AddContentLen_(buff, body_.size());
+        buff.Append(body_);
+        std::string().swap(body_);
+        return;
+    }
+    // 先查文件缓存，命中的文件一定存在且可读；没有缓存内容时 mmFileStat_ 也已经填好，不需要再 stat
+    cache_ = FileCache::Instance()->Get(path_, &mmFileStat_);
+    if (cache_) {
+        if (code_ == -1) code_ = 200;
+    }
+    // 判断请求的资源文件是否存在（不存在时 st_mode 为 0）或者是否为目录
+    else if (mmFileStat_.st_mode == 0 || S_ISDIR(mmFileStat_.st_mode)) {
         code_ = 404;        // 如果资源文件不存在或者为目录，则设置响应状态码为404
     }
     else if (!(mmFileStat_.st_mode & S_IROTH)) {
@@ -75,10 +110,12 @@ void HttpResponse::MakeResponse(Buffer& buff) {
 }
 
 char* HttpResponse::File() {
+    if (cache_) return const_cast<char*>(cache_->content.data());
     return mmFile_;
 }
 
 size_t HttpResponse::FileLen() const {
+    if (cache_) return cache_->content.size();
     return mmFileStat_.st_size;
 }
 
@@ -88,6 +125,11 @@ void HttpResponse::UnmapFile() {
         munmap(mmFile_, mmFileStat_.st_size);   // 调用 munmap 函数取消映射 mmFile_ 指向的内存区域
         mmFile_ = nullptr;
     }
+    if (fileFd_ >= 0) {
+        close(fileFd_);
+        fileFd_ = -1;
+    }
+    cache_.reset();
 }
 
 // 构建错误页面内容
@@ -98,12 +140,8 @@ void HttpResponse::ErrorContent(Buffer& buff, std::string message) {
     body += "<body bgcolor=\"ffffff\">";
 
     // 获取状态码对应的状态信息
-    if (CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
-        status = "Bad Request";
-    }
+    const StatusEntry* entry = FindStatus_(code_);
+    status = entry ? entry->status : "Bad Request";
 
     // 构建错误页面的状态行
     body += std::to_string(code_) + " : " + status  + "\n";
@@ -120,47 +158,67 @@ void HttpResponse::ErrorContent(Buffer& buff, std::string message) {
 
 void HttpResponse::ErrorHtml_() {
     // 检查是否有与状态码对应的错误页面路径
-    if (CODE_PATH.count(code_) == 1) {
-        path_ = CODE_PATH.find(code_)->second;
-        // 获取错误页面的文件状态，存到 mmFileStat_ 中
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+    const StatusEntry* entry = FindStatus_(code_);
+    if (entry && entry->errorPath) {
+        path_ = entry->errorPath;
+        // 错误页面同样先查缓存，没有缓存内容时错误页面的文件状态存到 mmFileStat_ 中
+        cache_ = FileCache::Instance()->Get(path_, &mmFileStat_);
     }
 }
 
 // 添加 HTTP 响应的状态行到指定的缓冲区
 void HttpResponse::AddStateLine_(Buffer& buff) {
-    std::string status;
     // 检查状态码是否在已知的状态码集合中
-    if (CODE_STATUS.count(code_) == 1) {
-        // 如果是，获取对应的状态信息
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
+    const StatusEntry* entry = FindStatus_(code_);
+    if (!entry) {
         // 如果状态码未知，默认为400 Bad Request
         code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+        entry = FindStatus_(400);
     }
-    // 将状态行添加到缓冲区中
-    buff.Append("HTTP/1.1 " + std::to_string(code_) + " " + status + "\r\n");
+    // 将预先拼好的状态行添加到缓冲区中
+    buff.Append(entry->line.data, entry->line.len);
 }
 
 // 添加 HTTP 响应的头部信息到指定的缓冲区
 void HttpResponse::AddHeader_(Buffer& buff) {
     // 添加 Connection 头部
-    buff.Append("Connection: ");
-    if (isKeepAlive_) {
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
+    const ByteStr& conn = isKeepAlive_ ? CONN_KEEP_ALIVE : CONN_CLOSE;
+    buff.Append(conn.data, conn.len);
+    // 添加 Date 头部，按秒缓存的字符串
+    buff.Append(CoarseClock::HttpDate(), CoarseClock::HTTP_DATE_LEN);
+    // 添加 Content-type 头部，命中缓存时和 Content-length 一起在 AddContent_ 中添加
+    if (!cache_) {
+        const ByteStr& type = FindMime_(path_)->header;
+        buff.Append(type.data, type.len);
     }
-    else {
-        buff.Append("close\r\n");
-    }
-    // 添加 Content-type 头部
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+}
+
+// 把 "Content-length: <len>\r\n\r\n" 直接写到缓冲区的可写区域，不经过临时字符串
+void HttpResponse::AddContentLen_(Buffer& buff, size_t len) {
+    static const char KEY[] = "Content-length: ";
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + len % 10;
+        len /= 10;
+    } while (len);
+
+    buff.EnsureWritable(sizeof(KEY) - 1 + n + 4);
+    char* p = buff.BeginWrite();
+    memcpy(p, KEY, sizeof(KEY) - 1);
+    p += sizeof(KEY) - 1;
+    while (n) *p++ = digits[--n];
+    memcpy(p, "\r\n\r\n", 4);
+    buff.HasWritten(p + 4 - buff.BeginWrite());
 }
 
 // 向缓冲区中添加响应内容
 void HttpResponse::AddContent_(Buffer& buff) {
+    if (cache_) {
+        // 内容在缓存中，只需要追加预先生成的响应头
+        buff.Append(cache_->header);
+        return;
+    }
     int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
     if (srcFd < 0) {
         // 如果文件打开失败，添加文件未找到的错误内容并返回
@@ -168,11 +226,32 @@ void HttpResponse::AddContent_(Buffer& buff) {
         return;
     }
 
+    // 缓存里的文件状态可能是一个校验周期之前的，按打开的文件重新取大小
+    if (fstat(srcFd, &mmFileStat_) < 0) {
+        close(srcFd);
+        ErrorContent(buff, "File NotFound!");
+        return;
+    }
+
     LOG_DEBUG("file path %s", (srcDir_ + path_).data());
+    if (mmFileStat_.st_size == 0) {     // 空文件既不需要映射也不需要发送
+        close(srcFd);
+        AddContentLen_(buff, 0);
+        return;
+    }
+    if (zeroCopy) {
+        // 零拷贝模式：保留文件描述符，由 HttpConn::write 用 sendfile 直接从页缓存发送到套接字，
+        // 省去每个请求的 mmap/munmap 和缺页开销
+        fileFd_ = srcFd;
+        AddContentLen_(buff, mmFileStat_.st_size);
+        return;
+    }
+
     // 将文件映射到内存提高文件的访问速度  MAP_PRIVATE 建立一个写入时拷贝的私有映射
     // 私有映射意味着对映射内存的修改不会影响到原文件
     int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if (*mmRet == -1) {
+    if (mmRet == MAP_FAILED) {
+        close(srcFd);
         ErrorContent(buff, "File NotFound!");
         return;
     }
@@ -180,7 +259,7 @@ void HttpResponse::AddContent_(Buffer& buff) {
     mmFile_ = (char*)mmRet;
     close(srcFd);
     // 添加 Content-length 头部
-    buff.Append("Content-length: " + std::to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    AddContentLen_(buff, mmFileStat_.st_size);
 }
 
 /*
@@ -205,24 +284,35 @@ video/mp4：MP4 视频文件
 */
 
 // 根据文件路径的后缀来确定文件的 MIME 类型
-std::string HttpResponse::GetFileType_() {
+std::string HttpResponse::GetFileType(const std::string& path) {
+    return FindMime_(path)->type;
+}
+
+// 查找后缀对应的类型，表只有十几项，顺序比较比哈希查找（还要先 substr 出后缀）更便宜
+const HttpResponse::MimeEntry* HttpResponse::FindMime_(const std::string& path) {
     // 查找路径中最后一个点的位置
-    std::string::size_type idx = path_.find_last_of('.');
+    std::string::size_type idx = path.find_last_of('.');
     // 如果找不到点，则默认返回文本类型
     if (idx == std::string::npos) {     // 最大值 find函数在找不到指定值得情况下会返回string::npos
-        return "text/plain";    
+        return &DEFAULT_TYPE;
     }
 
-    // 提取后缀
-    std::string suffix = path_.substr(idx);
-    // 检查后缀是否在已知的后缀类型映射中
-    if (SUFFIX_TYPE.count(suffix) == 1) {
-        // 如果是，则返回对应的 MIME 类型
-        return SUFFIX_TYPE.find(suffix)->second;
+    // 检查后缀是否在已知的后缀类型表中
+    const char* suffix = path.c_str() + idx;
+    for (const MimeEntry& entry : SUFFIX_TYPE) {
+        if (strcmp(entry.suffix, suffix) == 0) {
+            return &entry;
+        }
     }
     // 如果后缀未知，默认返回文本类型
-    return "text/plain";
+    return &DEFAULT_TYPE;
 }
 
-
-
+const HttpResponse::StatusEntry* HttpResponse::FindStatus_(int code) {
+    for (const StatusEntry& entry : CODE_STATUS) {
+        if (entry.code == code) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
\ No newline at end of file
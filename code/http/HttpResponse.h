@@ -5,31 +5,63 @@
 #include <unistd.h>       
 #include <sys/stat.h>
 #include <sys/mman.h>  
-#include <unordered_map>
+#include <memory>
 
 #include "../buffer/Buffer.h"
 #include "../log/Log.h"
+#include "FileCache.h"
+#include "../timer/CoarseClock.h"
 
 class HttpResponse {
 public:
     HttpResponse();
     ~HttpResponse();
 
-    void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
+    void Init(const char* srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
+    // 响应内容不是文件而是生成的字符串（例如 /__metrics），MakeResponse 时随响应头一起写进缓冲区
+    void InitBody(std::string body, const char* contentType, bool isKeepAlive = false);
     void MakeResponse(Buffer& buff);
     void UnmapFile();
     char* File();
+    int FileFd() const { return fileFd_; }     // 零拷贝模式下打开的文件描述符，由 HttpConn 用 sendfile 发送
     size_t FileLen() const;
     void ErrorContent(Buffer& buff, std::string message);
     int Code() const { return code_;}
+    bool IsKeepAlive() const { return isKeepAlive_; }
+
+    static bool zeroCopy;       // 零拷贝模式：文件不做 mmap，只保留打开的 fd
+    static std::string GetFileType(const std::string& path);   // 根据后缀确定 MIME 类型
 
 private:
+    // 编译期确定长度的字节串，响应中固定的部分都预先拼好，直接整段拷进缓冲区
+    struct ByteStr {
+        template<size_t N>
+        constexpr ByteStr(const char (&s)[N]) : data(s), len(N - 1) {}
+        const char* data;
+        size_t len;
+    };
+
+    struct StatusEntry {        // 状态码、状态信息、状态行、错误页面
+        int code;
+        const char* status;
+        ByteStr line;
+        const char* errorPath;  // nullptr 表示没有错误页面
+    };
+
+    struct MimeEntry {          // 文件后缀、MIME 类型、Content-type 头部
+        const char* suffix;
+        const char* type;
+        ByteStr header;
+    };
+
     void AddStateLine_(Buffer& buff);
     void AddHeader_(Buffer& buff);
     void AddContent_(Buffer& buff);
+    static void AddContentLen_(Buffer& buff, size_t len);  // 直接把 Content-length 头部和空行写进缓冲区
 
     void ErrorHtml_();
-    std::string GetFileType_();
+    static const StatusEntry* FindStatus_(int code);
+    static const MimeEntry* FindMime_(const std::string& path);
 
 private:
     int code_;                  // 响应状态码
@@ -37,13 +69,19 @@ private:
 
     std::string path_;          // 请求路径
     std::string srcDir_;
+    std::string body_;          // InitBody 设置的响应内容
+    const char* bodyType_;      // 不为 nullptr 时响应内容是 body_，不是文件
 
     char* mmFile_;              // 文件映射指针
+    int fileFd_;                // 零拷贝模式下打开的文件
+    std::shared_ptr<const CachedFile> cache_;  // 命中文件缓存时引用缓存中的内容，发送完之前不会被释放
     struct stat mmFileStat_;    // 文件状态
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE; // 文件后缀类型集
-    static const std::unordered_map<int, std::string> CODE_STATUS;         // 状态码集
-    static const std::unordered_map<int, std::string> CODE_PATH;           // 编码路径集    
+    static const MimeEntry SUFFIX_TYPE[];      // 文件后缀类型集
+    static const MimeEntry DEFAULT_TYPE;       // 未知后缀按纯文本处理
+    static const StatusEntry CODE_STATUS[];    // 状态码集（含状态行和错误页面路径）
+    static const ByteStr CONN_KEEP_ALIVE;      // 持久连接的 Connection 头部
+    static const ByteStr CONN_CLOSE;
 };
 
 #endif // HTTP_RESPONSE_H
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "RegisterBatcher.h"
+
+#include <string.h>
+#include <algorithm>
+
+RegisterBatcher::RegisterBatcher(int flushDelayMs, SqlConnPool* connPool)
+    : connPool_(connPool), flushDelay_(flushDelayMs), isClosed_(false) {
+    assert(flushDelayMs >= 0 && connPool);
+    writer_ = std::thread(&RegisterBatcher::Run_, this);
+}
+
+RegisterBatcher::~RegisterBatcher() {
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        isClosed_ = true;
+    }
+    cond_.notify_all();
+    if (writer_.joinable()) writer_.join();
+}
+
+void RegisterBatcher::Submit(const std::string& name, const std::string& pwd, Done done) {
+    size_t size;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        size = names_.insert(name).second ? queue_.size() + 1 : 0;
+        if (size > 0) queue_.push_back({name, pwd, std::move(done), false, std::chrono::steady_clock::now()});
+    }
+    if (size == 0) {
+        // 同名的注册还在排队或者正在写入，查重时它还不在表里
+        LOG_INFO("user used!");
+        done(false);
+        return;
+    }
+    // 只有从空变成非空（写线程在等第一个）和攒满一批（写线程在等超时）时才需要叫醒写线程
+    if (size == 1 || size == static_cast<size_t>(INSERT_BATCH_ROWS)) cond_.notify_one();
+}
+
+size_t RegisterBatcher::Pending() {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return queue_.size();
+}
+
+void RegisterBatcher::Run_() {
+    std::vector<Entry> batch;
+    std::unique_lock<std::mutex> locker(mtx_);
+    while (true) {
+        cond_.wait(locker, [this] { return isClosed_ || !queue_.empty(); });
+        if (queue_.empty()) return;     // 已经关闭并且都写完了
+        // 不满一批时等到最早的一个到期，期间攒满了就提前写
+        if (!isClosed_ && queue_.size() < static_cast<size_t>(INSERT_BATCH_ROWS)) {
+            auto deadline = queue_.front().enqueued + flushDelay_;
+            cond_.wait_until(locker, deadline, [this] {
+                return isClosed_ || queue_.size() >= static_cast<size_t>(INSERT_BATCH_ROWS);
+            });
+        }
+        size_t n = std::min(queue_.size(), static_cast<size_t>(INSERT_BATCH_ROWS));
+        batch.clear();
+        for (size_t i = 0; i < n; i++) {
+            batch.emplace_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        locker.unlock();
+        Flush_(batch);
+        locker.lock();
+    }
+}
+
+void RegisterBatcher::Flush_(std::vector<Entry>& batch) {
+    // Submit 已经去掉了同名的，一批里的用户名互不相同
+    std::vector<Entry*> rows;
+    for (auto& entry : batch) rows.push_back(&entry);
+    {
+        MYSQL* sql = nullptr;
+        SqlConnRAII conn(&sql, connPool_);
+        if (!sql) {
+            LOG_WARN("RegisterBatcher: no sql connection available!");
+        }
+        else if (InsertRows_(sql, rows)) {
+            for (Entry* entry : rows) entry->ok = true;
+        }
+        else if (rows.size() > 1) {
+            // 整批失败时退回逐行插入，分清楚是哪个用户出的问题
+            LOG_WARN("RegisterBatcher: batch of %d failed, retry one by one", static_cast<int>(rows.size()));
+            std::vector<Entry*> one(1);
+            for (Entry* entry : rows) {
+                one[0] = entry;
+                entry->ok = InsertRows_(sql, one);
+            }
+        }
+    }
+    // 已经提交（或者失败），之后的查重能在表里看到它们，同名的不用再在这里拦
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        for (auto& entry : batch) names_.erase(entry.name);
+    }
+    // 连接放回连接池以后再回调
+    for (auto& entry : batch) {
+        entry.done(entry.ok);
+    }
+}
+
+// 一行和满一批用连接上预编译好的语句，其他行数临时预编译
+bool RegisterBatcher::InsertRows_(MYSQL* sql, const std::vector<Entry*>& rows) {
+    int n = static_cast<int>(rows.size());
+    assert(n > 0 && n <= INSERT_BATCH_ROWS);
+    MYSQL_STMT* stmt = nullptr;
+    bool temp = false;
+    if (n == 1) {
+        stmt = connPool_->GetStmt(sql, STMT_INSERT_USER);
+    }
+    else if (n == INSERT_BATCH_ROWS) {
+        stmt = connPool_->GetStmt(sql, STMT_INSERT_USER_BATCH);
+    }
+    else {
+        stmt = SqlConnPool::Prepare(sql, SqlConnPool::InsertUserSql(n).c_str());
+        temp = true;
+    }
+    if (!stmt) {
+        LOG_ERROR("No prepared statement for user insert!");
+        return false;
+    }
+
+    std::vector<unsigned long> lens(2 * n);
+    std::vector<MYSQL_BIND> param(2 * n);
+    memset(param.data(), 0, param.size() * sizeof(MYSQL_BIND));
+    for (int i = 0; i < n; i++) {
+        const std::string* fields[2] = {&rows[i]->name, &rows[i]->pwd};
+        for (int j = 0; j < 2; j++) {
+            int k = 2 * i + j;
+            lens[k] = fields[j]->size();
+            param[k].buffer_type = MYSQL_TYPE_STRING;
+            param[k].buffer = const_cast<char*>(fields[j]->data());
+            param[k].buffer_length = lens[k];
+            param[k].length = &lens[k];
+        }
+    }
+
+    bool ok = true;
+    if (mysql_stmt_bind_param(stmt, param.data()) || mysql_stmt_execute(stmt)) {
+        LOG_ERROR("Insert user error: %s", mysql_stmt_error(stmt));
+        ok = false;
+    }
+    if (temp) mysql_stmt_close(stmt);
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    if (ok) rows_.fetch_add(n, std::memory_order_relaxed);
+    return ok;
+}
@@ -0,0 +1,70 @@
+#ifndef REGISTER_BATCHER_H
+#define REGISTER_BATCHER_H
+
+/*
+ * 注册的批量写入：查重通过的新用户先排队，由一个专门的写线程攒成一条多行 INSERT 执行
+ * 攒够 INSERT_BATCH_ROWS 行或者最早的一个等了 flushDelayMs 就写一次，语句执行成功（自动提交）后才回调，
+ * 注册集中到来时一批只要一次往返，插入吞吐随批量增大，而不是每个用户一次往返。
+ * 查重在数据库线程上做，两个同名的注册可能都查不到对方：排队中和正在写入的用户名记在 names_ 里，
+ * 同名的直接失败；写完以后才查重、晚到的同名注册由 username 上的唯一索引挡住，
+ * 整批失败时退回逐行插入，每个用户拿到自己的结果。
+ */
+
+#include <mysql/mysql.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "../pool/SqlConnPool.h"
+
+class RegisterBatcher {
+public:
+    typedef std::function<void(bool)> Done;     // 参数为是否注册成功，在写线程上调用（同名的正在排队时在 Submit 里直接调用）
+
+    explicit RegisterBatcher(int flushDelayMs = 2, SqlConnPool* connPool = SqlConnPool::Instance());
+    ~RegisterBatcher();     // 把排队的写完再退出
+
+    RegisterBatcher(const RegisterBatcher&) = delete;
+    RegisterBatcher& operator=(const RegisterBatcher&) = delete;
+
+    void Submit(const std::string& name, const std::string& pwd, Done done);
+    size_t Pending();
+
+    uint64_t Batches() const { return batches_.load(std::memory_order_relaxed); }  // 执行过的 INSERT 条数
+    uint64_t Rows() const { return rows_.load(std::memory_order_relaxed); }        // 写入成功的用户数
+
+private:
+    struct Entry {
+        std::string name;
+        std::string pwd;
+        Done done;
+        bool ok;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    void Run_();
+    void Flush_(std::vector<Entry>& batch);
+    bool InsertRows_(MYSQL* sql, const std::vector<Entry*>& rows);   // 一条语句插入 rows，全部成功返回 true
+
+    SqlConnPool* connPool_;
+    std::chrono::milliseconds flushDelay_;
+
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::deque<Entry> queue_;
+    std::unordered_set<std::string> names_;    // 排队中和正在写入的用户名
+    bool isClosed_;
+    std::thread writer_;
+
+    std::atomic<uint64_t> batches_{0}, rows_{0};
+};
+
+#endif // REGISTER_BATCHER_H
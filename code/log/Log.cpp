@@ -1,32 +1,54 @@
 #include "Log.h"
 
+// 线程退出时把自己的环形缓冲区标记为无主，剩下的日志由写线程取完后丢弃
+struct LogRingHolder {
+    static thread_local bool dead;      // 已经析构（线程退出过程中其他对象的析构函数还可能写日志）
+    std::shared_ptr<LogRing> ring;
+
+    ~LogRingHolder() {
+        dead = true;
+        if (ring) {
+            ring->orphan.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local bool LogRingHolder::dead = false;
+static thread_local LogRingHolder localRing;
+
 Log::Log() {
-    fp_ = nullptr;
-    deque_ = nullptr;
+    fd_ = -1;
     writeThread_ = nullptr;
     lineCount_ = 0;
     toDay_ = 0;
+    isOpen_ = false;
+    level_ = 1;
     isAsync_ = false;
+    deferred_ = false;
+    ringCapacity_ = 0;
+    dropped_ = 0;
+    stop_ = false;
+    flushReq_ = false;
 }
 
 Log::~Log() {
-    while (!deque_->empty()) {
-        deque_->flush();        // 唤醒消费者，处理掉剩下的任务，强制置空
+    if (writeThread_ && writeThread_->joinable()) {     // 只有异步日志才有写线程
+        stop_ = true;
+        flush();
+        writeThread_->join();       // 写线程把剩下的日志写完才退出
     }
-    deque_->Close();            // 关闭队列
-    writeThread_->join();       // 等待当前线程完成手中任务
-    if (fp_) {
+    if (fd_ >= 0) {
         std::lock_guard<std::mutex> locker(mtx_);
-        flush();                // 清空缓冲区中的数据
-        fclose(fp_);            // 关闭日志文件
+        WriteBatch_();
+        close(fd_);             // 关闭日志文件
     }
 }
 
 void Log::flush() {
-    if (isAsync_) {
-        deque_->flush();    // 只有异步才会用到阻塞队列
+    // 已经有人叫过写线程了就不再 notify，缓冲区过半后每条日志都会调到这里，避免每条一次 futex 系统调用
+    if (isAsync_ && !flushReq_.exchange(true, std::memory_order_acq_rel)) {
+        cond_.notify_one();
     }
-    fflush(fp_);        // 清空缓冲区
 }
 
 // 懒汉模式，局部静态变量法（不需要加锁和解锁操作）
@@ -40,28 +62,42 @@ void Log::FlushLogThread() {
     Log::Instance()->AsyncWrite_();
 }
 
-// 异步日志的写线程真正执行的函数
+// 异步日志的写线程真正执行的函数：定时或者被唤醒后，把所有线程缓冲区里的日志取出来，一次 write 写入文件
 void Log::AsyncWrite_() {
-    std::string str = "";
-    while (deque_->pop(str)) {
-        std::lock_guard<std::mutex> locker(mtx_);
-        fputs(str.c_str(), fp_);
+    std::unique_lock<std::mutex> locker(mtx_);     // 写文件期间持有，和同步写日志互斥
+    while (true) {
+        cond_.wait_for(locker, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this] {
+            return flushReq_.load(std::memory_order_acquire) || stop_.load(std::memory_order_acquire);
+        });
+        flushReq_.store(false, std::memory_order_relaxed);
+        bool stopping = stop_.load(std::memory_order_acquire);
+        DrainRings_();
+        WriteBatch_();
+        if (stopping) {
+            return;
+        }
     }
 }
 
-void Log::init(int level, const char* path, const char* suffix, int maxQueueCapacity) {
-    isOpen_ = true;
+void Log::init(int level, const char* path, const char* suffix, int maxQueueCapacity, bool deferred) {
     level_ = level;
     path_ = path;
     suffix_ = suffix;
+
+    time_t timer = time(nullptr);
+    struct tm t;
+    localtime_r(&timer, &t);
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        lineCount_ = 0;
+        OpenFile_(t, 0);
+    }
+
     if (maxQueueCapacity) {     // 异步方式
         isAsync_ = true;
-        if (!deque_) {      // 为空则创建一个
-            std::unique_ptr<BlockQueue<std::string>> newDeque(new BlockQueue<std::string>);
-            // 因为unique_ptr不支持普通的拷贝或赋值操作,所以采用move
-            // 将动态申请的内存权给deque，newDeque被释放
-            deque_ = std::move(newDeque);
-
+        // 原来是阻塞队列的条数，现在换算成每个线程环形缓冲区的字节数（按一条日志 128 字节估算）
+        ringCapacity_ = static_cast<size_t>(maxQueueCapacity) * 128;
+        if (!writeThread_) {
             std::unique_ptr<std::thread> newThread(new std::thread(FlushLogThread));
             writeThread_ = std::move(newThread);
         }
@@ -69,122 +105,231 @@ void Log::init(int level, const char* path, const char* suffix, int maxQueueCapa
     else {
         isAsync_ = false;
     }
+    deferred_ = isAsync_ && deferred;       // 同步写没有写线程，延迟格式化没有意义
+    isOpen_ = true;
+}
 
-    lineCount_ = 0;
-    time_t timer = time(nullptr);
-    struct tm* sysTime = localtime(&timer);
-    struct tm t = *sysTime;
-    path_ = path;
-    suffix_ = suffix;
-    
+void Log::OpenFile_(const struct tm& t, int part) {
     char fileName[LOG_NAME_LEN] = {0};
-    snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", 
-            path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
+    if (part == 0) {
+        snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", 
+                path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
+    }
+    else {
+        snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d-%d%s", 
+                path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, part, suffix_);
+    }
     toDay_ = t.tm_mday;
 
-    {
-        std::lock_guard<std::mutex> locker(mtx_);
-        buff_.RetrieveAll();        // 清空缓冲区
-        if (fp_) {
-            flush();
-            fclose(fp_);
-        }
-        fp_ = fopen(fileName, "a");     // 打开文件读取并附加写入
-        if (fp_ == nullptr) {
-            mkdir(path_, 0777);
-            fp_ = fopen(fileName, "a");     // 生成目录文件（最大权限）
-        }
-        assert(fp_ != nullptr);
+    if (fd_ >= 0) {
+        close(fd_);
     }
+    fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);     // 打开文件附加写入
+    if (fd_ < 0) {
+        mkdir(path_, 0777);
+        fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);  // 生成目录文件（最大权限）
+    }
+    assert(fd_ >= 0);
 }
 
 void Log::write(int level, const char* format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec;
-    struct tm* sysTime = localtime(&tSec);
-    struct tm t = *sysTime;
+    // 先在栈上格式化整条日志，不碰任何共享状态
+    char line[LINE_LEN];
+    int n = FormatPrefix_(line, CoarseClock::RealNow(), level);
+
     va_list vaList;
+    va_start(vaList, format);
+    int m = vsnprintf(line + n, LINE_LEN - n, format, vaList);
+    va_end(vaList);
+    if (m < 0) return;
 
-    // 日志日期 日志行数  如果不是今天或行数超了
-    if (toDay_ != t.tm_mday || (lineCount_ && (lineCount_  %  MAX_LINES == 0)))
-    {
-        std::unique_lock<std::mutex> locker(mtx_);
-        locker.unlock();
-        
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-
-        if (toDay_ != t.tm_mday)    // 时间不匹配，则替换为最新的日志文件名
-        {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            lineCount_ = 0;
+    if (n + m + 1 < LINE_LEN) {
+        line[n + m] = '\n';
+        Push_(line, n + m + 1);
+        return;
+    }
+    // 太长了，换到堆上重新格式化
+    std::string longLine(line, n);
+    longLine.resize(n + m + 1);
+    va_start(vaList, format);
+    vsnprintf(&longLine[n], m + 1, format, vaList);
+    va_end(vaList);
+    longLine[n + m] = '\n';
+    Push_(longLine.data(), longLine.size());
+}
+
+void Log::Push_(const char* line, size_t len) {
+    LogRing* ring = isAsync_ ? LocalRing_() : nullptr;
+    if (!ring) {
+        // 同步方式（直接向文件中写入日志信息）
+        std::lock_guard<std::mutex> locker(mtx_);
+        Append_(line, len);
+        WriteBatch_();
+        return;
+    }
+
+    // 异步方式（放进本线程的环形缓冲区，等待写线程取走）
+    if (len > ring->Capacity() / 4) {
+        // 超长的日志截断，末尾的换行要保留，否则下一条日志会接在同一行
+        std::string cut(line, ring->Capacity() / 4 - 1);
+        cut.push_back('\n');
+        TryPush_(ring, LogRing::TEXT, cut.data(), cut.size());
+        return;
+    }
+    TryPush_(ring, LogRing::TEXT, line, len);
+}
+
+void Log::PushRecord_(const char* rec, size_t len) {
+    LogRing* ring = LocalRing_();
+    if (!ring || len > ring->Capacity() / 4) {
+        // 线程正在退出或者缓冲区太小，退回到当场格式化
+        std::string line;
+        FormatRecord_(rec, len, line);
+        Push_(line.data(), line.size());
+        return;
+    }
+    TryPush_(ring, LogRing::BINARY, rec, len);
+}
+
+bool Log::TryPush_(LogRing* ring, uint32_t kind, const char* data, size_t len) {
+    for (int i = 0; !ring->TryPush(kind, data, len); i++) {
+        if (i == 64) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);      // 写线程跟不上，丢弃这一条
+            return false;
+        }
+        flush();
+        std::this_thread::yield();
+    }
+    if (ring->Size() > ring->Capacity() / 2) {
+        flush();        // 超过一半了，提前叫醒写线程
+    }
+    return true;
+}
+
+void Log::FormatRecord_(const char* rec, size_t len, std::string& out) {
+    LogFormat::RecordHeader hdr;
+    memcpy(&hdr, rec, sizeof(hdr));
+    struct timespec ts;
+    ts.tv_sec = hdr.sec;
+    ts.tv_nsec = static_cast<long>(hdr.usec) * 1000;
+    char prefix[PREFIX_LEN];
+    out.assign(prefix, FormatPrefix_(prefix, ts, hdr.level));
+    LogFormat::Format(hdr.format, rec + sizeof(hdr), len - sizeof(hdr), out);
+    out.push_back('\n');
+}
+
+LogRing* Log::LocalRing_() {
+    if (LogRingHolder::dead) return nullptr;
+    if (!localRing.ring) {
+        localRing.ring = std::make_shared<LogRing>(ringCapacity_);
+        std::lock_guard<std::mutex> locker(ringMtx_);
+        rings_.push_back(localRing.ring);
+    }
+    return localRing.ring.get();
+}
+
+void Log::DrainRings_() {
+    std::lock_guard<std::mutex> locker(ringMtx_);
+    for (size_t i = 0; i < rings_.size(); ) {
+        // 先看是否无主再取：无主之后不会再有新日志，取完就可以丢弃
+        bool orphan = rings_[i]->orphan.load(std::memory_order_acquire);
+        rings_[i]->Drain([this](uint32_t kind, const char* data, size_t len) {
+            if (kind == LogRing::TEXT) {
+                Append_(data, len);
+            }
+            else if (kind == LogRing::BINARY) {
+                FormatRecord_(data, len, line_);
+                Append_(line_.data(), line_.size());
+            }
+        });
+        if (orphan) {
+            rings_[i] = rings_.back();
+            rings_.pop_back();
         }
         else {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_  / MAX_LINES), suffix_);
+            i++;
         }
-        
-        locker.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(newFile, "a");
-        assert(fp_ != nullptr);
     }
+}
 
-    // 在buffer内生成一条对应的日志消息
-    {
-        std::unique_lock<std::mutex> locker(mtx_);
-        lineCount_++;
-        int n = snprintf(buff_.BeginWrite(), 128, "%04d/%02d/%02d %02d:%02d:%02d.%06ld ", 
-                        t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-        buff_.HasWritten(n);
-        AppendLogLevelTitle_(level);
-
-        va_start(vaList, format);
-        int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
-        va_end(vaList);
-
-        buff_.HasWritten(m);
-        buff_.Append("\n\0", 2);
-
-        if (isAsync_ && deque_ && !deque_->full()) {    // 异步方式（加入阻塞队列中，等待写线程读取日志信息）
-            deque_->push_back(buff_.RetrieveAllToStr());
+void Log::Append_(const char* line, size_t len) {
+    // 日志行数到了上限，换一个文件
+    if (lineCount_ && (lineCount_ % MAX_LINES == 0)) {
+        WriteBatch_();
+        time_t timer = time(nullptr);
+        struct tm t;
+        localtime_r(&timer, &t);
+        if (toDay_ != t.tm_mday) {
+            lineCount_ = 0;
         }
-        else {      // 同步方式（直接向文件中写入日志信息）
-            fputs(buff_.Peek(), fp_);
+        OpenFile_(t, lineCount_ / MAX_LINES);
+    }
+    lineCount_++;
+    batch_.append(line, len);
+    if (batch_.size() >= static_cast<size_t>(BATCH_LEN)) {
+        WriteBatch_();
+    }
+}
+
+void Log::WriteBatch_() {
+    if (batch_.empty() || fd_ < 0) return;
+
+    // 日期变了，替换为最新的日志文件名
+    time_t timer = time(nullptr);
+    struct tm t;
+    localtime_r(&timer, &t);
+    if (toDay_ != t.tm_mday) {
+        lineCount_ = 0;
+        OpenFile_(t, 0);
+    }
+
+    const char* p = batch_.data();
+    size_t left = batch_.size();
+    while (left > 0) {
+        ssize_t len = ::write(fd_, p, left);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            break;
         }
-        buff_.RetrieveAll();
+        p += len;
+        left -= len;
+    }
+    batch_.clear();
+}
+
+// "YYYY/MM/DD HH:MM:SS.uuuuuu [level]: "，日期时间部分按秒缓存，这里只拼微秒
+int Log::FormatPrefix_(char* buf, const struct timespec& ts, int level) {
+    memcpy(buf, CoarseClock::LogTime(ts.tv_sec), CoarseClock::LOG_TIME_LEN);
+    char* p = buf + CoarseClock::LOG_TIME_LEN;
+    *p++ = '.';
+    int usec = static_cast<int>(ts.tv_nsec / 1000);
+    for (int i = 5; i >= 0; i--) {
+        p[i] = static_cast<char>('0' + usec % 10);
+        usec /= 10;
     }
+    p += 6;
+    *p++ = ' ';
+    const char* title = LevelTitle_(level);
+    size_t len = strlen(title);
+    memcpy(p, title, len);
+    return static_cast<int>(p + len - buf);
 }
 
-void Log::AppendLogLevelTitle_(int level) {
+const char* Log::LevelTitle_(int level) {
     switch(level) {
     case 0:
-        buff_.Append("[debug]: ", 9);
-        break;
+        return "[debug]: ";
     case 1:
-        buff_.Append("[info] : ", 9);
-        break;
+        return "[info] : ";
     case 2:
-        buff_.Append("[warn] : ", 9);
-        break;
+        return "[warn] : ";
     case 3:
-        buff_.Append("[error]: ", 9);
-        break;
+        return "[error]: ";
     default:
-        buff_.Append("[info] : ", 9);
-        break;
+        return "[info] : ";
     }
 }
 
-int Log::GetLevel() {
-    std::lock_guard<std::mutex> locker(mtx_);
-    return level_;
-}
-
 void Log::SetLevel(int level) {
-    std::lock_guard<std::mutex> locker(mtx_);
-    level_ = level;
-}
\ No newline at end of file
+    level_.store(level, std::memory_order_relaxed);
+}
@@ -4,41 +4,82 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <condition_variable>
 #include <sys/time.h>
+#include <time.h>           // clock_gettime
 #include <string.h>
 #include <stdarg.h>         // vastart va_end
 #include <assert.h>
+#include <fcntl.h>          // open
+#include <unistd.h>         // write close
 #include <sys/stat.h>       // mkdir
-#include "BlockQueue.h"
-#include "../buffer/Buffer.h"
+#include "LogRing.h"
+#include "LogFormat.h"
+#include "../timer/CoarseClock.h"
 
 class Log {
 public:
     void init(int level, const char* path = "./log",
                 const char* suffix = ".log",
-                int maxQueueCapacity = 1024);       // 初始化日志实例（阻塞队列最大容量、保存路径、文件后缀）
+                int maxQueueCapacity = 1024,
+                bool deferred = false);     // 初始化日志实例（异步缓冲容量、保存路径、文件后缀），容量为 0 时同步写；deferred 开启延迟格式化
     
     static Log* Instance();     
     static void FlushLogThread();       // 异步写日志公有方法，调用私有方法AsyncWrite_()
     
     void write(int level, const char* format, ...);       // 将输出内容按照标准格式整理
-    void flush();       // 强制刷新缓冲区
+
+    // 延迟格式化：只把格式串指针、时间戳和原始参数编码进本线程的环形缓冲区，由写线程格式化
+    template<class... Args>
+    void WriteDeferred(int level, const char* format, const Args&... args) {
+        char rec[LINE_LEN];
+        LogFormat::RecordHeader hdr;
+        hdr.format = format;
+        struct timespec now = CoarseClock::RealNow();   // 事件循环线程上是缓存的时间，不读时钟
+        hdr.sec = now.tv_sec;
+        hdr.usec = static_cast<int32_t>(now.tv_nsec / 1000);
+        hdr.level = level;
+        memcpy(rec, &hdr, sizeof(hdr));
+        size_t len = sizeof(hdr);
+        LogFormat::EncodeAll(rec, len, sizeof(rec), args...);      // 放不下的参数丢掉，格式化时原样输出转换说明
+        PushRecord_(rec, len);
+    }
+    void flush();       // 异步：唤醒写线程把各线程缓冲区中的日志写入文件；同步：每条日志已经直接写入文件
     
-    int GetLevel();
+    // 每条日志都要判断一次等级，用原子变量，不加锁
+    int GetLevel() const { return level_.load(std::memory_order_relaxed); }
     void SetLevel(int level);
-    bool IsOpen() { return isOpen_;}
-    
+    bool IsOpen() const { return isOpen_.load(std::memory_order_relaxed); }
+    bool IsDeferred() const { return deferred_; }
+    size_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }  // 缓冲区满被丢弃的日志条数
 
 private:
     Log();
-    void AppendLogLevelTitle_(int level);       // 添加日志等级标题
     virtual ~Log();
+    static const char* LevelTitle_(int level);      // 日志等级标题
+    static int FormatPrefix_(char* buf, const struct timespec& ts, int level);   // 时间和等级前缀，返回长度（不超过 PREFIX_LEN）
+    LogRing* LocalRing_();      // 当前线程的环形缓冲区，第一次调用时创建并登记
+    void Push_(const char* line, size_t len);       // 放进当前线程的环形缓冲区
+    void PushRecord_(const char* rec, size_t len);  // 放入一条二进制记录，放不进环形缓冲区的当场格式化
+    bool TryPush_(LogRing* ring, uint32_t kind, const char* data, size_t len);
+    void FormatRecord_(const char* rec, size_t len, std::string& out);  // 把二进制记录格式化成一行日志
     void AsyncWrite_();     // 异步写日志方法
+    void DrainRings_();     // 把各线程缓冲区中的日志取到 batch_
+    void Append_(const char* line, size_t len);     // 追加一行到 batch_，行数到了就换文件
+    void WriteBatch_();     // 用一次 write(2) 把 batch_ 写入文件
+    void OpenFile_(const struct tm& t, int part);   // 打开 t 那天第 part 个日志文件
 
 private:
     static const int LOG_PATH_LEN = 256;        // 日志文件最长文件名
     static const int LOG_NAME_LEN = 256;        // 日志最长名
     static const int MAX_LINES = 50000;         // 日志文件内的最长日志条数
+    static const int PREFIX_LEN = 64;           // 时间和等级前缀的最大长度
+    static const int LINE_LEN = 1024;           // 一条日志先在栈上格式化，超过这个长度才用堆
+    static const int FLUSH_INTERVAL_MS = 20;    // 写线程至少每隔这么久把缓冲区写入文件一次
+    static const int BATCH_LEN = 1 << 20;       // 攒够这么多字节就先写一次
 
     const char* path_;          // 路径名
     const char* suffix_;        // 后缀名
@@ -48,24 +89,33 @@ private:
     int lineCount_;             // 日志行数记录
     int toDay_;                 // 按日期区分文件
 
-    bool isOpen_;
-
-    Buffer buff_;       // 输出的内容，缓冲区
-    int level_;         // 日志等级
+    std::atomic<bool> isOpen_;
+    std::atomic<int> level_;    // 日志等级
     bool isAsync_;      // 是否开启异步日志
+    bool deferred_;     // 是否延迟格式化（只在异步日志下生效）
+    size_t ringCapacity_;       // 每个线程环形缓冲区的字节数
+
+    int fd_;                                                // 日志文件
+    std::string batch_;                                     // 写线程攒起来一次写入的内容（后台缓冲）
+    std::string line_;                                      // 写线程格式化二进制记录用
+
+    std::mutex ringMtx_;                                    // 只在登记新线程和写线程取日志时使用
+    std::vector<std::shared_ptr<LogRing>> rings_;           // 各线程的环形缓冲区（前台缓冲）
+    std::atomic<size_t> dropped_;
 
-    FILE* fp_;                                              // 打开log的文件指针
-    std::unique_ptr<BlockQueue<std::string>> deque_;        // 阻塞队列
+    std::atomic<bool> stop_;
+    std::atomic<bool> flushReq_;
     std::unique_ptr<std::thread> writeThread_;              // 写线程的指针
-    std::mutex mtx_;                                        // 同步日志必需的互斥量
+    std::mutex mtx_;                                        // 同步写日志以及写线程等待用
+    std::condition_variable cond_;
 };
 
 #define LOG_BASE(level, format, ...) \
     do {\
         Log* log = Log::Instance();\
         if (log->IsOpen() && log->GetLevel() <= level) {\
-            log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
+            if (log->IsDeferred()) log->WriteDeferred(level, format, ##__VA_ARGS__); \
+            else log->write(level, format, ##__VA_ARGS__); \
         }\
     } while(0);
 
@@ -77,4 +127,4 @@ private:
 #define LOG_WARN(format, ...) do {LOG_BASE(2, format, ##__VA_ARGS__)} while(0);
 #define LOG_ERROR(format, ...) do {LOG_BASE(3, format, ##__VA_ARGS__)} while(0);
 
-#endif // LOG_H
\ No newline at end of file
+#endif // LOG_H
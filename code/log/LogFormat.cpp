@@ -0,0 +1,221 @@
+#include "LogFormat.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+namespace LogFormat {
+
+namespace {
+
+struct Arg {
+    ArgType type;
+    int64_t i;
+    uint64_t u;
+    double f;
+    const void* p;
+    const char* s;
+    uint32_t n;
+    uint8_t size;       // 整数参数原来的字节数（4 或 8）
+};
+
+class ArgReader {
+public:
+    ArgReader(const char* data, size_t len) : p_(data), end_(data + len) {}
+
+    bool Next(Arg& arg) {
+        if (p_ >= end_) return false;
+        arg.type = static_cast<ArgType>(*p_++);
+        arg.size = 8;
+        switch (arg.type) {
+        case I64: return Get_(&arg.i, 8);
+        case U64: return Get_(&arg.u, 8);
+        case I32: {
+            int32_t x;
+            if (!Get_(&x, 4)) return false;
+            arg.type = I64;
+            arg.i = x;
+            arg.size = 4;
+            return true;
+        }
+        case U32: {
+            uint32_t x;
+            if (!Get_(&x, 4)) return false;
+            arg.type = U64;
+            arg.u = x;
+            arg.size = 4;
+            return true;
+        }
+        case F64: return Get_(&arg.f, 8);
+        case PTR: return Get_(&arg.p, sizeof(arg.p));
+        case STR:
+            if (!Get_(&arg.n, 4) || p_ + arg.n > end_) return false;
+            arg.s = p_;
+            p_ += arg.n;
+            return true;
+        default:
+            p_ = end_;
+            return false;
+        }
+    }
+
+private:
+    bool Get_(void* dst, size_t n) {
+        if (p_ + n > end_) return false;
+        memcpy(dst, p_, n);
+        p_ += n;
+        return true;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+int64_t AsInt(const Arg& arg) {
+    switch (arg.type) {
+    case I64: return arg.i;
+    case U64: return static_cast<int64_t>(arg.u);
+    case F64: return static_cast<int64_t>(arg.f);
+    default: return 0;
+    }
+}
+
+// %u %o %x 按参数原来的宽度截断，int 的 -1 和直接 printf 一样输出 ffffffff
+uint64_t AsUnsigned(const Arg& arg) {
+    uint64_t u = static_cast<uint64_t>(AsInt(arg));
+    return arg.size == 4 ? static_cast<uint32_t>(u) : u;
+}
+
+void Append(std::string& out, const char* spec, const Arg& arg, char conv) {
+    char tmp[512];
+    int n = 0;
+    switch (conv) {
+    case 'd': case 'i':
+        n = snprintf(tmp, sizeof(tmp), spec, static_cast<long long>(AsInt(arg)));
+        break;
+    case 'u': case 'o': case 'x': case 'X':
+        n = snprintf(tmp, sizeof(tmp), spec, static_cast<unsigned long long>(AsUnsigned(arg)));
+        break;
+    case 'c':
+        n = snprintf(tmp, sizeof(tmp), spec, static_cast<int>(AsInt(arg)));
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        n = snprintf(tmp, sizeof(tmp), spec, arg.type == F64 ? arg.f : static_cast<double>(AsInt(arg)));
+        break;
+    case 'p':
+        n = snprintf(tmp, sizeof(tmp), spec, arg.type == PTR ? arg.p : nullptr);
+        break;
+    case 's':
+        if (arg.type == STR) {
+            std::string s(arg.s, arg.n);
+            n = snprintf(tmp, sizeof(tmp), spec, s.c_str());
+            if (n >= static_cast<int>(sizeof(tmp))) {
+                out.append(s);      // 长字符串直接追加，宽度/精度在这里意义不大
+                return;
+            }
+        }
+        else {
+            n = snprintf(tmp, sizeof(tmp), "%s", "(?)");
+        }
+        break;
+    default:
+        return;
+    }
+    if (n > 0) {
+        out.append(tmp, std::min(static_cast<size_t>(n), sizeof(tmp) - 1));
+    }
+}
+
+void AppendInt(std::string& out, int64_t v, bool isUnsigned) {
+    char tmp[24];
+    char* end = tmp + sizeof(tmp);
+    char* p = end;
+    uint64_t u = (isUnsigned || v >= 0) ? static_cast<uint64_t>(v) : 0 - static_cast<uint64_t>(v);
+    do {
+        *--p = static_cast<char>('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (!isUnsigned && v < 0) *--p = '-';
+    out.append(p, end - p);
+}
+
+} // namespace
+
+void Format(const char* format, const char* args, size_t argsLen, std::string& out) {
+    ArgReader reader(args, argsLen);
+    const char* p = format;
+    while (*p) {
+        if (*p != '%') {
+            const char* q = strchr(p, '%');
+            size_t n = q ? static_cast<size_t>(q - p) : strlen(p);
+            out.append(p, n);
+            p += n;
+            continue;
+        }
+        if (p[1] == '%') {
+            out.push_back('%');
+            p += 2;
+            continue;
+        }
+
+        // 解析一个转换说明 %[flags][width][.precision][length]conversion，长度修饰统一换成 ll/无
+        const char* start = p++;
+        char spec[80] = "%";
+        size_t specLen = 1;
+        Arg arg;
+        while (*p && strchr("-+ #0", *p) && specLen < 8) spec[specLen++] = *p++;
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*p != '.') break;
+                spec[specLen++] = *p++;
+            }
+            if (*p == '*') {
+                p++;
+                specLen += snprintf(spec + specLen, 16, "%d", reader.Next(arg) ? static_cast<int>(AsInt(arg)) : 0);
+            }
+            while (*p >= '0' && *p <= '9') {
+                if (specLen < 40) spec[specLen++] = *p;
+                p++;
+            }
+        }
+        while (*p && strchr("hlLqjzt", *p)) p++;
+        char conv = *p;
+        if (!conv) {
+            out.append(start);
+            break;
+        }
+        p++;
+        if (!strchr("diuoxXcfFeEgGaAps", conv)) {
+            out.append(start, p - start);       // 不认识的转换原样输出
+            continue;
+        }
+        if (!reader.Next(arg)) {
+            out.append(start, p - start);       // 参数不够
+            continue;
+        }
+
+        // 没有标志、宽度、精度的 %d %u %s 最常见，不走 snprintf
+        if (specLen == 1) {
+            if ((conv == 'd' || conv == 'i') && arg.type != F64) {
+                AppendInt(out, AsInt(arg), arg.type == U64);
+                continue;
+            }
+            if (conv == 'u' && arg.type != F64) {
+                AppendInt(out, static_cast<int64_t>(AsUnsigned(arg)), true);
+                continue;
+            }
+            if (conv == 's' && arg.type == STR) {
+                out.append(arg.s, arg.n);
+                continue;
+            }
+        }
+        if (strchr("diuoxX", conv)) {
+            spec[specLen++] = 'l';
+            spec[specLen++] = 'l';
+        }
+        spec[specLen++] = conv;
+        spec[specLen] = '\0';
+        Append(out, spec, arg, conv);
+    }
+}
+
+} // namespace LogFormat
@@ -0,0 +1,115 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+/*
+ * 延迟格式化日志的二进制记录
+ * 请求线程只把 格式串指针 + 时间戳 + 等级 + 原始参数 编码成一条二进制记录，
+ * 由日志的写线程按格式串解码、格式化成文本。
+ * 格式串必须是字符串字面量（LOG_* 宏的用法本来就是这样），写线程解码时它仍然有效；
+ * 字符串参数在编码时就拷贝进记录，不依赖调用者的缓冲区（例如 inet_ntoa 的静态缓冲）。
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+namespace LogFormat {
+
+enum ArgType : uint8_t { I64 = 1, U64, F64, STR, PTR, I32, U32 };     // I32/U32 是不超过 int 宽度的整数
+
+struct RecordHeader {
+    const char* format;
+    int64_t sec;        // 粗粒度时钟的秒和微秒
+    int32_t usec;
+    int32_t level;
+};
+
+// 把 n 字节追加到 buf[len, cap)，空间不够返回 false
+inline bool Put(char* buf, size_t& len, size_t cap, const void* data, size_t n) {
+    if (len + n > cap) return false;
+    memcpy(buf + len, data, n);
+    len += n;
+    return true;
+}
+
+inline bool PutTagged(char* buf, size_t& len, size_t cap, ArgType type, const void* data, size_t n) {
+    uint8_t tag = type;
+    return len + 1 + n <= cap && Put(buf, len, cap, &tag, 1) && Put(buf, len, cap, data, n);
+}
+
+inline bool EncodeStr(char* buf, size_t& len, size_t cap, const char* s, size_t n) {
+    if (len + 1 + 4 > cap) return false;
+    if (len + 1 + 4 + n > cap) n = cap - len - 5;       // 放不下就截断
+    uint8_t tag = STR;
+    uint32_t n32 = static_cast<uint32_t>(n);
+    return Put(buf, len, cap, &tag, 1) && Put(buf, len, cap, &n32, 4) && Put(buf, len, cap, s, n);
+}
+
+// 整数（含 bool、char、枚举）
+// 不超过 int 的按 4 字节记录，和直接 printf 时整型提升后的宽度一致，写线程格式化 %u %o %x 时按它截断
+template<class T>
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, bool>::type
+Encode(char* buf, size_t& len, size_t cap, const T& v) {
+    if (sizeof(T) <= sizeof(int32_t)) {
+        if (std::is_signed<T>::value) {
+            int32_t x = static_cast<int32_t>(v);
+            return PutTagged(buf, len, cap, I32, &x, sizeof(x));
+        }
+        uint32_t x = static_cast<uint32_t>(v);
+        return PutTagged(buf, len, cap, U32, &x, sizeof(x));
+    }
+    if (std::is_signed<T>::value) {
+        int64_t x = static_cast<int64_t>(v);
+        return PutTagged(buf, len, cap, I64, &x, sizeof(x));
+    }
+    uint64_t x = static_cast<uint64_t>(v);
+    return PutTagged(buf, len, cap, U64, &x, sizeof(x));
+}
+
+template<class T>
+typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+Encode(char* buf, size_t& len, size_t cap, const T& v) {
+    double x = static_cast<double>(v);
+    return PutTagged(buf, len, cap, F64, &x, sizeof(x));
+}
+
+inline bool Encode(char* buf, size_t& len, size_t cap, const char* s) {
+    if (!s) s = "(null)";
+    return EncodeStr(buf, len, cap, s, strlen(s));
+}
+
+inline bool Encode(char* buf, size_t& len, size_t cap, char* s) {
+    return Encode(buf, len, cap, static_cast<const char*>(s));
+}
+
+template<size_t N>
+bool Encode(char* buf, size_t& len, size_t cap, const char (&s)[N]) {
+    return EncodeStr(buf, len, cap, s, strnlen(s, N));
+}
+
+inline bool Encode(char* buf, size_t& len, size_t cap, const std::string& s) {
+    return EncodeStr(buf, len, cap, s.data(), s.size());
+}
+
+template<class T>
+bool Encode(char* buf, size_t& len, size_t cap, T* p) {
+    const void* x = p;
+    return PutTagged(buf, len, cap, PTR, &x, sizeof(x));
+}
+
+inline bool EncodeAll(char*, size_t&, size_t) {
+    return true;
+}
+
+template<class T, class... Args>
+bool EncodeAll(char* buf, size_t& len, size_t cap, const T& first, const Args&... rest) {
+    return Encode(buf, len, cap, first) && EncodeAll(buf, len, cap, rest...);
+}
+
+// 解码一条记录：按格式串逐个取参数格式化，结果（不含时间和等级）追加到 out
+void Format(const char* format, const char* args, size_t argsLen, std::string& out);
+
+} // namespace LogFormat
+
+#endif // LOG_FORMAT_H
@@ -0,0 +1,103 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+/*
+ * 日志用的单生产者单消费者环形缓冲区
+ * 每个写日志的线程独占一个，生产者是这个线程，消费者是日志的写线程，两边都不加锁。
+ * 缓冲区里存放的是一条条记录：8 字节的记录头（长度 + 类型）+ 内容，按 8 字节对齐，
+ * 一条记录总是连续存放，放不下时在末尾填一条 PAD 记录，从头开始放。
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+
+class LogRing {
+public:
+    enum Kind : uint32_t { PAD = 0, TEXT = 1, BINARY = 2 };     // BINARY：延迟格式化的二进制记录，见 LogFormat.h
+
+    explicit LogRing(size_t capacity = 128 * 1024) : orphan(false),
+            buf_(new char[RoundUp_(capacity)]), mask_(RoundUp_(capacity) - 1), head_(0), tail_(0) {}
+
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    // 生产者：放入一条记录，空间不够返回 false
+    bool TryPush(uint32_t kind, const void* data, size_t len) {
+        size_t need = Align_(HEADER + len);
+        size_t cap = mask_ + 1;
+        if (need > cap / 2) return false;       // 太长的记录不收，调用者应当截断
+
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t offset = tail & mask_;
+        size_t toEnd = cap - offset;
+        size_t pad = toEnd < need ? toEnd : 0;  // 末尾放不下就跳到开头
+        if (tail + pad + need - head > cap) return false;
+
+        if (pad) {
+            WriteHeader_(offset, PAD, pad - HEADER);
+            tail += pad;
+            offset = 0;
+        }
+        WriteHeader_(offset, kind, len);
+        memcpy(buf_.get() + offset + HEADER, data, len);
+        tail_.store(tail + need, std::memory_order_release);
+        return true;
+    }
+
+    // 消费者：依次处理已经放入的记录 f(kind, data, len)，处理完释放空间，返回处理的记录数
+    template<class F>
+    size_t Drain(F&& f) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t cnt = 0;
+        while (head != tail) {
+            size_t offset = head & mask_;
+            uint32_t hdr[2];
+            memcpy(hdr, buf_.get() + offset, HEADER);
+            if (hdr[1] != PAD) {
+                f(hdr[1], buf_.get() + offset + HEADER, static_cast<size_t>(hdr[0]));
+                cnt++;
+            }
+            head += Align_(HEADER + hdr[0]);
+        }
+        head_.store(head, std::memory_order_release);
+        return cnt;
+    }
+
+    size_t Size() const {       // 已用字节数（近似值）
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    size_t Capacity() const { return mask_ + 1; }
+
+    std::atomic<bool> orphan;   // 所属线程已经退出，写线程取完剩下的记录后就可以丢弃
+
+private:
+    static const size_t HEADER = 8;
+    static const size_t CACHE_LINE = 64;
+
+    static size_t Align_(size_t n) { return (n + 7) & ~static_cast<size_t>(7); }
+    static size_t RoundUp_(size_t n) {
+        size_t cap = 4096;
+        while (cap < n) cap <<= 1;
+        return cap;
+    }
+
+    void WriteHeader_(size_t offset, uint32_t kind, size_t len) {
+        uint32_t hdr[2] = {static_cast<uint32_t>(len), kind};
+        memcpy(buf_.get() + offset, hdr, HEADER);
+    }
+
+    std::unique_ptr<char[]> buf_;
+    const size_t mask_;
+    char pad0_[CACHE_LINE];
+    std::atomic<size_t> head_;      // 消费者的位置
+    char pad1_[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail_;      // 生产者的位置
+    char pad2_[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+#endif // LOG_RING_H
@@ -0,0 +1,157 @@
+#include "Metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace {
+
+struct CounterInfo {
+    const char* name;
+    const char* help;
+    double scale;           // 导出时乘上的系数
+};
+
+// 和 MetricCounter 一一对应
+const CounterInfo COUNTER_INFO[M_COUNTER_NUM] = {
+    {"webserver_accepts_total", "Accepted connections.", 1},
+    {"webserver_requests_total", "Responses generated.", 1},
+    {"webserver_received_bytes_total", "Bytes read from clients.", 1},
+    {"webserver_sent_bytes_total", "Bytes written to clients.", 1},
+    {"webserver_responses_4xx_total", "Responses with a 4xx status.", 1},
+    {"webserver_responses_5xx_total", "Responses with a 5xx status.", 1},
+    {"webserver_write_eagain_rearms_total", "Writes that hit EAGAIN and re-armed EPOLLOUT.", 1},
+    {"webserver_epoll_mods_total", "epoll_ctl(EPOLL_CTL_MOD) calls on client connections.", 1},
+    {"webserver_timer_expirations_total", "Connections closed by the idle timer.", 1},
+    {"webserver_db_requests_total", "Login/register requests handed to the database threads.", 1},
+    {"webserver_db_wait_seconds_total", "Total time login/register requests waited for the database.", 1e-6},
+};
+
+// 和 MetricHisto 一一对应
+const CounterInfo HISTO_INFO[H_HISTO_NUM] = {
+    {"webserver_parse_duration_seconds", "Time to parse one request.", 1e-9},
+    {"webserver_response_build_duration_seconds", "Time to build one response.", 1e-9},
+    {"webserver_request_duration_seconds", "From request bytes arriving to the response being fully written.", 1e-9},
+    {"webserver_db_wait_duration_seconds", "From submitting a login/register to its result.", 1e-9},
+};
+
+// 导出的 le：256ns ~ 16s 之间 2 的幂，正好是细分桶的边界
+const int LE_MIN_BITS = 8;
+const int LE_MAX_BITS = 34;
+
+const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+void AppendLine(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+void AppendLine(std::string& out, const char* fmt, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n > 0) out.append(line, n < static_cast<int>(sizeof(line)) ? n : sizeof(line) - 1);
+}
+
+} // namespace
+
+void Histogram::AddTo(Snapshot* snap) const {
+    for (int i = 0; i < BUCKETS; i++) {
+        snap->buckets[i] += buckets_[i].load(std::memory_order_relaxed);
+    }
+    snap->count += count_.load(std::memory_order_relaxed);
+    snap->sum += sum_.load(std::memory_order_relaxed);
+}
+
+Metrics* Metrics::Instance() {
+    static Metrics metrics;
+    return &metrics;
+}
+
+Metrics::~Metrics() {
+    for (Slot* slot : slots_) {
+        slot->~Slot();
+        free(slot);
+    }
+}
+
+// 每个线程一块，按缓存行对齐，相邻线程的计数器不会落在同一个缓存行上
+Metrics::Slot* Metrics::Register_() {
+    void* mem = nullptr;
+    size_t size = (sizeof(Slot) + 63) / 64 * 64;
+    if (posix_memalign(&mem, 64, size) != 0) abort();
+    Slot* slot = new (mem) Slot();
+    for (auto& c : slot->counters) c.store(0, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> locker(mtx_);
+    slots_.push_back(slot);
+    return slot;
+}
+
+void Metrics::SetCollector(Collector collector) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    collector_ = std::move(collector);
+}
+
+void Metrics::AppendMetric(std::string& out, const char* name, const char* type, const char* help, double value) {
+    AppendLine(out, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+}
+
+std::string Metrics::Render() {
+    uint64_t counters[M_COUNTER_NUM] = {};
+    std::vector<Histogram::Snapshot> histos(H_HISTO_NUM);
+    memset(histos.data(), 0, histos.size() * sizeof(Histogram::Snapshot));
+    Collector collector;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        for (const Slot* slot : slots_) {
+            for (int c = 0; c < M_COUNTER_NUM; c++) {
+                counters[c] += slot->counters[c].load(std::memory_order_relaxed);
+            }
+            for (int h = 0; h < H_HISTO_NUM; h++) {
+                slot->histos[h].AddTo(&histos[h]);
+            }
+        }
+        collector = collector_;
+    }
+
+    std::string out;
+    out.reserve(16384);
+    for (int c = 0; c < M_COUNTER_NUM; c++) {
+        AppendMetric(out, COUNTER_INFO[c].name, "counter", COUNTER_INFO[c].help, counters[c] * COUNTER_INFO[c].scale);
+    }
+    for (int h = 0; h < H_HISTO_NUM; h++) {
+        const char* name = HISTO_INFO[h].name;
+        const Histogram::Snapshot& snap = histos[h];
+        AppendLine(out, "# HELP %s %s\n# TYPE %s histogram\n", name, HISTO_INFO[h].help, name);
+        // 小于 2^bits ns 的个数就是下标小于 Index(2^bits) 的桶之和
+        uint64_t cum = 0;
+        int idx = 0;
+        for (int bits = LE_MIN_BITS; bits <= LE_MAX_BITS; bits++) {
+            int end = Histogram::Index(uint64_t(1) << bits);
+            for (; idx < end; idx++) cum += snap.buckets[idx];
+            AppendLine(out, "%s_bucket{le=\"%.9g\"} %llu\n", name, (uint64_t(1) << bits) * 1e-9, (unsigned long long)cum);
+        }
+        AppendLine(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)snap.count);
+        AppendLine(out, "%s_sum %.9g\n", name, snap.sum * 1e-9);
+        AppendLine(out, "%s_count %llu\n", name, (unsigned long long)snap.count);
+
+        // 细分桶上的分位数（取所在桶的上界），比上面按 2 的幂的 le 精确
+        AppendLine(out, "# HELP %s_quantile %s Quantiles since start.\n# TYPE %s_quantile gauge\n",
+                   name, HISTO_INFO[h].help, name);
+        for (double q : QUANTILES) {
+            uint64_t rank = static_cast<uint64_t>(q * snap.count + 0.5);
+            uint64_t seen = 0;
+            double value = 0;
+            for (int i = 0; snap.count > 0 && i < Histogram::BUCKETS; i++) {
+                seen += snap.buckets[i];
+                if (seen >= rank && seen > 0) {
+                    value = Histogram::LowerBound(i + 1) * 1e-9;
+                    break;
+                }
+            }
+            AppendLine(out, "%s_quantile{quantile=\"%g\"} %.9g\n", name, q, value);
+        }
+    }
+    if (collector) collector(out);
+    return out;
+}
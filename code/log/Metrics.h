@@ -0,0 +1,131 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+ * 运行时指标：计数器和延迟直方图，按 Prometheus 文本格式导出（WebServer 在 /__metrics 上提供）
+ * - 每个线程第一次记录时分到自己的一块（按缓存行对齐），只有这个线程写，
+ *   写的时候是普通的 load + store（relaxed），没有锁、没有原子读改写，也不会和别的线程抢缓存行；
+ * - 导出时遍历所有线程的块相加，线程退出后它的块保留，计数保持单调；
+ * - 直方图按 HDR 的思路分桶：每个 2 的幂区间再等分 8 份，相对误差不超过 12.5%，单位纳秒。
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum MetricCounter {
+    M_ACCEPTS,              // 接受的连接
+    M_REQUESTS,             // 生成的响应
+    M_BYTES_IN,
+    M_BYTES_OUT,
+    M_RESP_4XX,
+    M_RESP_5XX,
+    M_EAGAIN_REARMS,        // 写到 EAGAIN 后重新注册 EPOLLOUT
+    M_EPOLL_MODS,           // 连接的 epoll_ctl(MOD)
+    M_TIMER_EXPIRED,        // 超时关闭的连接
+    M_DB_REQUESTS,          // 交给数据库线程的登录/注册
+    M_DB_WAIT_US,           // 上面这些请求等数据库的总时间（微秒）
+    M_COUNTER_NUM,
+};
+
+enum MetricHisto {
+    H_PARSE,                // 解析一个请求
+    H_BUILD,                // 生成一个响应（不含发送）
+    H_REQUEST,              // 请求数据到达到响应发送完
+    H_DB_WAIT,              // 登录/注册提交给数据库线程到结果回来
+    H_HISTO_NUM,
+};
+
+// 单线程写、任意线程读的对数线性直方图
+class Histogram {
+public:
+    static const int SUB_BITS = 3;
+    static const int SUB = 1 << SUB_BITS;                   // 每个 2 的幂区间分成 8 个桶
+    static const int BUCKETS = 42 * SUB;                    // 最大约 2^43 ns，更大的记在最后一个桶
+
+    void Record(uint64_t value, uint64_t n = 1) {
+        Bump_(buckets_[Index(value)], n);
+        Bump_(count_, n);
+        Bump_(sum_, value * n);
+    }
+
+    static int Index(uint64_t value) {
+        if (value < static_cast<uint64_t>(SUB)) return static_cast<int>(value);
+        int msb = 63 - __builtin_clzll(value);
+        int idx = (msb - SUB_BITS + 1) * SUB + static_cast<int>((value >> (msb - SUB_BITS)) & (SUB - 1));
+        return idx < BUCKETS ? idx : BUCKETS - 1;
+    }
+    static uint64_t LowerBound(int idx) {
+        int mag = idx / SUB, sub = idx % SUB;
+        return mag == 0 ? sub : static_cast<uint64_t>(SUB + sub) << (mag - 1);
+    }
+
+    // 把当前的值累加到快照里（快照只在导出时使用）
+    struct Snapshot {
+        uint64_t buckets[BUCKETS];
+        uint64_t count;
+        uint64_t sum;
+    };
+    void AddTo(Snapshot* snap) const;
+
+private:
+    static void Bump_(std::atomic<uint64_t>& v, uint64_t n) {
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> buckets_[BUCKETS] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+class Metrics {
+public:
+    typedef std::function<void(std::string&)> Collector;    // 导出时追加额外的指标（连接数、连接池等）
+
+    static Metrics* Instance();
+
+    static void Add(MetricCounter c, uint64_t n = 1) {
+        std::atomic<uint64_t>& v = Local_()->counters[c];
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    static void Record(MetricHisto h, uint64_t ns, uint64_t n = 1) {
+        Local_()->histos[h].Record(ns, n);
+    }
+    static int64_t NowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    void SetCollector(Collector collector);
+    std::string Render();                   // Prometheus 文本格式
+
+    // 给 Collector 用的格式化函数
+    static void AppendMetric(std::string& out, const char* name, const char* type, const char* help, double value);
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> counters[M_COUNTER_NUM];
+        Histogram histos[H_HISTO_NUM];
+    };
+
+    Metrics() = default;
+    ~Metrics();
+
+    static Slot* Local_() {
+        static thread_local Slot* slot = nullptr;
+        if (!slot) slot = Instance()->Register_();
+        return slot;
+    }
+    Slot* Register_();
+
+    std::mutex mtx_;
+    std::vector<Slot*> slots_;              // 按缓存行对齐分配，进程退出时释放
+    Collector collector_;
+};
+
+#endif // METRICS_H
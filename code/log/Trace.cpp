@@ -0,0 +1,206 @@
+#include "Trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <algorithm>
+
+#include "Log.h"
+
+std::atomic<int> Tracer::sampleEvery_{0};
+std::atomic<uint32_t> Tracer::nextId_{1};
+int Tracer::wakeFd_ = -1;
+
+namespace {
+
+const char* const PHASE_NAME[T_PHASE_NUM] = {
+    "request", "dispatch", "queue", "read", "parse", "build", "write",
+    "first_byte", "last_byte", "db_queue", "db",
+};
+
+int64_t MonoNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// 导出时的一条 b/e/n 记录
+struct OutEvent {
+    double ts;          // 微秒
+    double dur;         // 所在区间的长度，时间相同时决定嵌套顺序
+    char ph;
+    TracePhase phase;
+    uint32_t id;
+    int tid;
+};
+
+// 时间相同时：先结束再开始；开始的长区间在前，结束的短区间在前，这样嵌套关系不会乱
+bool EventBefore(const OutEvent& a, const OutEvent& b) {
+    if (a.ts != b.ts) return a.ts < b.ts;
+    if (a.ph != b.ph) return a.ph == 'e';
+    return a.ph == 'e' ? a.dur < b.dur : a.dur > b.dur;
+}
+
+} // namespace
+
+Tracer* Tracer::Instance() {
+    static Tracer tracer;
+    return &tracer;
+}
+
+Tracer::~Tracer() {
+    Close();
+    for (Ring* ring : rings_) delete ring;
+}
+
+void Tracer::Init(int sampleEvery, const char* dir, int signo) {
+    if (sampleEvery <= 0 || dumper_.joinable()) return;
+    dir_ = dir;
+    mkdir(dir, 0777);
+    wakeFd_ = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd_ < 0) {
+        LOG_ERROR("Tracer eventfd error!");
+        return;
+    }
+    baseTick_ = Now();
+    baseNs_ = MonoNs();
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &Tracer::OnSignal_;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(signo, &sa, &oldAction_);
+    signo_ = signo;
+
+    stop_ = false;
+    dumper_ = std::thread(&Tracer::DumpLoop_, this);
+    sampleEvery_ = sampleEvery;
+    LOG_INFO("Tracing 1/%d requests, kill -%d %d to dump into %s", sampleEvery, signo, (int)getpid(), dir);
+}
+
+void Tracer::Close() {
+    if (!dumper_.joinable()) return;
+    sampleEvery_ = 0;
+    sigaction(signo_, &oldAction_, nullptr);
+    stop_ = true;
+    uint64_t one = 1;
+    ssize_t n = write(wakeFd_, &one, sizeof(one));
+    (void)n;
+    dumper_.join();
+    close(wakeFd_);
+    wakeFd_ = -1;
+}
+
+// 只调用异步信号安全的 write
+void Tracer::OnSignal_(int) {
+    int saved = errno;
+    uint64_t one = 1;
+    if (wakeFd_ >= 0) {
+        ssize_t n = write(wakeFd_, &one, sizeof(one));
+        (void)n;
+    }
+    errno = saved;
+}
+
+void Tracer::DumpLoop_() {
+    uint64_t cnt = 0;
+    while (true) {
+        ssize_t n = read(wakeFd_, &cnt, sizeof(cnt));
+        if (stop_) break;
+        if (n == sizeof(cnt)) Dump();
+    }
+}
+
+Tracer::Ring* Tracer::Register_() {
+    Ring* ring = new Ring();
+    ring->tid = static_cast<int>(syscall(SYS_gettid));
+    std::lock_guard<std::mutex> locker(mtx_);
+    rings_.push_back(ring);
+    return ring;
+}
+
+bool Tracer::Dump() {
+    // 时间戳换算成微秒：Init 以来的时间太短时先等一下，减小误差
+    if (MonoNs() - baseNs_ < 10000000) usleep(10000);
+    uint64_t tick = Now();
+    int64_t ns = MonoNs();
+    double ticksPerUs = (tick - baseTick_) / ((ns - baseNs_) / 1000.0);
+    if (ticksPerUs <= 0) ticksPerUs = 1;
+
+    std::vector<OutEvent> out;
+    std::vector<Ring*> rings;
+    int seq = 0;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        rings = rings_;
+        seq = dumpCnt_++;
+    }
+    for (Ring* ring : rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t from = head > RING_SIZE ? head - RING_SIZE : 0;
+        size_t start = out.size();
+        std::vector<uint64_t> index;
+        for (uint64_t i = from; i < head; i++) {
+            const Event& e = ring->events[i % RING_SIZE];
+            uint64_t tag = e.tag.load(std::memory_order_relaxed);
+            uint64_t begin = e.begin.load(std::memory_order_relaxed);
+            uint64_t end = e.end.load(std::memory_order_relaxed);
+            if (begin < baseTick_ || end < begin) continue;
+            OutEvent ev;
+            ev.ts = (begin - baseTick_) / ticksPerUs;
+            ev.dur = (end - begin) / ticksPerUs;
+            ev.phase = static_cast<TracePhase>(tag & 0xff);
+            ev.id = static_cast<uint32_t>(tag >> 8);
+            ev.tid = ring->tid;
+            if (ev.phase >= T_PHASE_NUM) continue;
+            if (ev.phase == T_FIRST_BYTE || ev.phase == T_LAST_BYTE) {
+                ev.ph = 'n';
+                out.push_back(ev);
+                index.push_back(i);
+            }
+            else {
+                ev.ph = 'b';
+                out.push_back(ev);
+                index.push_back(i);
+                ev.ph = 'e';
+                ev.ts += ev.dur;
+                out.push_back(ev);
+                index.push_back(i);
+            }
+        }
+        // 读的过程中写线程又写了记录，被覆盖（包括正在写的下一条）的那部分可能新旧混杂，丢掉
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t now = ring->head.load(std::memory_order_relaxed) + 1;
+        uint64_t valid = now > RING_SIZE ? now - RING_SIZE : 0;
+        size_t keep = start;
+        for (size_t k = start; k < out.size(); k++) {
+            if (index[k - start] >= valid) out[keep++] = out[k];
+        }
+        out.resize(keep);
+    }
+    std::sort(out.begin(), out.end(), EventBefore);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/trace-%d-%d.json", dir_.c_str(), (int)getpid(), seq);
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        LOG_ERROR("Open trace file %s error!", path);
+        return false;
+    }
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < out.size(); i++) {
+        const OutEvent& ev = out[i];
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"%c\",\"id\":%u,\"ts\":%.3f,\"pid\":%d,\"tid\":%d}%s\n",
+                PHASE_NAME[ev.phase], ev.ph, ev.id, ev.ts, (int)getpid(), ev.tid, i + 1 < out.size() ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+    fclose(fp);
+    LOG_INFO("Trace dumped: %s, %d events", path, (int)out.size());
+    return true;
+}
@@ -0,0 +1,138 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * 按请求的阶段追踪（默认关闭）
+ * - 每 N 个请求抽一个，记录它各个阶段的起止时间：epoll 唤醒到投递、在线程池里排队、读、解析、生成响应、
+ *   每次写、第一个字节和最后一个字节发出、数据库排队和执行；
+ * - 时间戳在 x86 上是 rdtsc（十几个时钟周期），导出时用 CLOCK_MONOTONIC 换算成微秒，其他架构直接用 CLOCK_MONOTONIC；
+ * - 每个线程一个环形缓冲区，只有这个线程写，满了覆盖最旧的记录；没被抽中的请求只多一次线程局部计数；
+ * - 收到信号（默认 SIGUSR2）后由后台线程把所有环形缓冲区导出成 Chrome trace event 格式的 JSON，
+ *   用 chrome://tracing 或 https://ui.perfetto.dev 打开，每个请求是一条异步轨道，各阶段是它下面的嵌套区间。
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum TracePhase {
+    T_REQUEST,          // 整个请求：开始读到最后一个字节发出（或者连接关闭）
+    T_DISPATCH,         // epoll_wait 返回到事件被投递（事件循环处理同一批里前面的事件）
+    T_QUEUE,            // 在线程池的任务队列里排队
+    T_READ,
+    T_PARSE,
+    T_BUILD,            // HttpResponse::MakeResponse（stat/open/mmap 或查文件缓存）
+    T_WRITE,            // 一次 writev/sendfile
+    T_FIRST_BYTE,       // 瞬时事件
+    T_LAST_BYTE,        // 瞬时事件
+    T_DB_QUEUE,         // 在 DbExecutor 的队列里排队
+    T_DB,               // 提交给数据库线程到结果回来（注册包括批量写入）
+    T_PHASE_NUM,
+};
+
+// 事件循环记下的时间，随任务带到工作线程；追踪关闭时都是 0
+struct TraceStamp {
+    uint64_t wake = 0;      // 这一轮 epoll_wait 返回的时间
+    uint64_t enqueue = 0;   // 投递到线程池的时间，0 表示没有经过线程池
+};
+
+class Tracer {
+public:
+    static const size_t RING_SIZE = 8192;       // 每个线程保留的最近的记录数
+
+    static Tracer* Instance();
+
+    // sampleEvery 为 0 时不追踪；导出的文件放在 dir 下
+    void Init(int sampleEvery, const char* dir, int signo = SIGUSR2);
+    void Close();
+    bool Dump();                                // 导出一次，也可以直接调用
+
+    static bool Enabled() { return sampleEvery_.load(std::memory_order_relaxed) > 0; }
+
+    static uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+    }
+
+    // 抽中时返回请求的编号，否则返回 0
+    static uint32_t Sample() {
+        static thread_local uint32_t count = 0;
+        uint32_t every = static_cast<uint32_t>(sampleEvery_.load(std::memory_order_relaxed));
+        if (every == 0 || ++count < every) return 0;
+        count = 0;
+        return nextId_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void Record(TracePhase phase, uint32_t id, uint64_t begin, uint64_t end) {
+        Local_()->Push(phase, id, begin, end);
+    }
+    static void Mark(TracePhase phase, uint32_t id) {
+        uint64_t now = Now();
+        Record(phase, id, now, now);
+    }
+
+private:
+    struct Event {
+        std::atomic<uint64_t> tag;      // 请求编号 << 8 | 阶段
+        std::atomic<uint64_t> begin;
+        std::atomic<uint64_t> end;
+    };
+
+    // 单线程写的环形缓冲区，导出线程按 head 读，读的过程中被覆盖的记录丢弃
+    struct Ring {
+        std::atomic<uint64_t> head{0};
+        int tid = 0;
+        Event events[RING_SIZE];
+
+        void Push(TracePhase phase, uint32_t id, uint64_t begin, uint64_t end) {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            Event& e = events[h % RING_SIZE];
+            e.tag.store(static_cast<uint64_t>(id) << 8 | phase, std::memory_order_relaxed);
+            e.begin.store(begin, std::memory_order_relaxed);
+            e.end.store(end, std::memory_order_relaxed);
+            head.store(h + 1, std::memory_order_release);
+        }
+    };
+
+    Tracer() = default;
+    ~Tracer();
+
+    static Ring* Local_() {
+        static thread_local Ring* ring = nullptr;
+        if (!ring) ring = Instance()->Register_();
+        return ring;
+    }
+    Ring* Register_();
+    void DumpLoop_();
+    static void OnSignal_(int);
+
+    static std::atomic<int> sampleEvery_;
+    static std::atomic<uint32_t> nextId_;
+    static int wakeFd_;                 // 信号处理函数写它唤醒导出线程
+
+    std::mutex mtx_;
+    std::vector<Ring*> rings_;
+    std::string dir_;
+    int signo_ = 0;
+    struct sigaction oldAction_;
+    std::atomic<bool> stop_{false};
+    std::thread dumper_;
+    int dumpCnt_ = 0;
+    uint64_t baseTick_ = 0;             // Init 时的时间戳，导出的时间从这里算起
+    int64_t baseNs_ = 0;
+};
+
+#endif // TRACE_H
@@ -6,7 +6,13 @@ int main()
     WebServer server(
         9006, 3, 60000,     // 端口 ET模式 timeoutMs 
         3306, "root", "yhp20001122..", "my_webserver_db",   // 数据库端口，用户名，密码，数据库名
-        12, 8, true, 1, 1024);  // 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量
+        12, 8, true, 1, 1024,   // 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量
+        0,                      // Reactor数量（0：单Reactor+线程池，>0：每个线程一个事件循环）
+        true,                   // 零拷贝发送文件（sendfile）
+        0,                      // 任务亲和（0：任意工作线程，1：按fd固定工作线程，2：再绑定CPU）
+        false,                  // 日志延迟格式化（请求线程只记录原始参数，由写线程格式化）
+        0,                      // 请求追踪（0：关闭，N：每N个请求抽一个，kill -USR2 导出到 ./log）
+        false);                 // io_uring（只用于多Reactor模式，内核不支持时退回epoll）
     server.Start();
 
 
@@ -0,0 +1,51 @@
+#include "DbExecutor.h"
+
+DbExecutor::DbExecutor(int numThreads, SqlConnPool* connPool) : connPool_(connPool), isClosed_(false) {
+    assert(numThreads > 0 && connPool);
+    for (int i = 0; i < numThreads; i++) {
+        threads_.emplace_back(&DbExecutor::Run_, this);
+    }
+}
+
+// 关闭时把已经提交的任务执行完，任务的完成回调要能处理服务器已经在退出的情况
+DbExecutor::~DbExecutor() {
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        isClosed_ = true;
+    }
+    cond_.notify_all();
+    for (auto& t : threads_) {
+        if (t.joinable()) t.join();
+    }
+}
+
+void DbExecutor::Submit(Job job) {
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        jobs_.emplace_back(std::move(job));
+    }
+    cond_.notify_one();
+}
+
+size_t DbExecutor::Pending() {
+    std::lock_guard<std::mutex> locker(mtx_);
+    return jobs_.size();
+}
+
+void DbExecutor::Run_() {
+    std::unique_lock<std::mutex> locker(mtx_);
+    while (true) {
+        cond_.wait(locker, [this] { return isClosed_ || !jobs_.empty(); });
+        if (jobs_.empty()) return;      // 已经关闭并且任务都执行完了
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+        locker.unlock();
+        {
+            MYSQL* sql = nullptr;
+            SqlConnRAII conn(&sql, connPool_);  // 连接池空时 GetConn 返回 nullptr
+            if (!sql) LOG_WARN("DbExecutor: no sql connection available!");
+            job(sql);
+        }
+        locker.lock();
+    }
+}
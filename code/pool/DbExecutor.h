@@ -0,0 +1,45 @@
+#ifndef DB_EXECUTOR_H
+#define DB_EXECUTOR_H
+
+/*
+ * 数据库执行器：几个专门的线程执行会阻塞的数据库操作
+ * 请求处理线程（线程池的工作线程或者 Reactor 线程）只提交任务，不等结果；
+ * 任务在数据库线程上从 SqlConnPool 取一个连接执行，完成后由任务自己把结果投递回连接所属的事件循环。
+ * 数据库慢的时候只有数据库线程在等，静态文件请求不受影响。
+ */
+
+#include <mysql/mysql.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SqlConnPool.h"
+
+class DbExecutor {
+public:
+    typedef std::function<void(MYSQL*)> Job;    // 参数是从连接池取到的连接，取不到时为 nullptr
+
+    explicit DbExecutor(int numThreads = 4, SqlConnPool* connPool = SqlConnPool::Instance());
+    ~DbExecutor();
+
+    DbExecutor(const DbExecutor&) = delete;
+    DbExecutor& operator=(const DbExecutor&) = delete;
+
+    void Submit(Job job);
+    size_t Pending();       // 排队中还没开始执行的任务数
+
+private:
+    void Run_();
+
+    SqlConnPool* connPool_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::deque<Job> jobs_;
+    bool isClosed_;
+    std::vector<std::thread> threads_;
+};
+
+#endif // DB_EXECUTOR_H
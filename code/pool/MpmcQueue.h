@@ -0,0 +1,121 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+/*
+ * 有界无锁多生产者多消费者队列（Dmitry Vyukov 的环形队列）。
+ * 每个槽位带一个序号：生产者用 CAS 抢占 enqueuePos_，看到槽位序号等于自己的位置才写入；
+ * 消费者同理。没有锁，也不会因为某个线程被挂起而阻塞其他线程在别的槽位上的操作。
+ * 队列满或空时 TryPush/TryPop 直接返回 false，由调用者决定重试、溢出还是休眠。
+ */
+
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity = 1024);
+    ~MpmcQueue();
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool TryPush(T&& item);     // 满了返回 false，item 保持不变
+    bool TryPop(T& item);       // 空了返回 false
+    bool Empty() const;         // 近似值，只用于判断是否值得去取
+    size_t Capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    static const size_t CACHE_LINE = 64;
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    char pad0_[CACHE_LINE];
+    std::atomic<size_t> enqueuePos_;        // 生产者和消费者的位置放在不同的缓存行，避免伪共享
+    char pad1_[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeuePos_;
+    char pad2_[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+template<typename T>
+MpmcQueue<T>::MpmcQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;     // 容量向上取整到 2 的幂，用掩码代替取模
+    cells_.reset(new Cell[size]);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; i++) {
+        cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    enqueuePos_.store(0, std::memory_order_relaxed);
+    dequeuePos_.store(0, std::memory_order_relaxed);
+}
+
+template<typename T>
+MpmcQueue<T>::~MpmcQueue() {
+    T item;
+    while (TryPop(item)) {}     // 析构还没被取走的元素
+}
+
+template<typename T>
+bool MpmcQueue<T>::TryPush(T&& item) {
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos & mask_];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {        // 槽位空闲，抢占这个位置
+            if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {    // 槽位还没被消费，队列满
+            return false;
+        }
+        else {                  // 被别的生产者抢先了，重新读位置
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+    }
+    new (&cell->storage) T(std::move(item));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MpmcQueue<T>::TryPop(T& item) {
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells_[pos & mask_];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {    // 槽位还没写入，队列空
+            return false;
+        }
+        else {
+            pos = dequeuePos_.load(std::memory_order_relaxed);
+        }
+    }
+    T* slot = reinterpret_cast<T*>(&cell->storage);
+    item = std::move(*slot);
+    slot->~T();
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);   // 留给下一圈的生产者
+    return true;
+}
+
+template<typename T>
+bool MpmcQueue<T>::Empty() const {
+    return dequeuePos_.load(std::memory_order_acquire) >= enqueuePos_.load(std::memory_order_acquire);
+}
+
+#endif // MPMC_QUEUE_H
@@ -1,66 +1,336 @@
 #include "SqlConnPool.h"
 
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include "../timer/CoarseClock.h"
+
+// 和 SqlStmt 一一对应
+static const std::string& StmtSql(int id) {
+    static const std::string sqls[STMT_NUM] = {
+        "SELECT password FROM user WHERE username=? LIMIT 1",
+        SqlConnPool::InsertUserSql(1),
+        SqlConnPool::InsertUserSql(INSERT_BATCH_ROWS),
+    };
+    return sqls[id];
+}
+
+std::string SqlConnPool::InsertUserSql(int rows) {
+    assert(rows > 0);
+    std::string sql = "INSERT INTO user(username, password) VALUES(?, ?)";
+    for (int i = 1; i < rows; i++) {
+        sql += ",(?, ?)";
+    }
+    return sql;
+}
+
 SqlConnPool* SqlConnPool::Instance() {
     static SqlConnPool connPool;
     return &connPool;
 }
 
 void SqlConnPool::Init(const char* host, int port, const char* user,
-                       const char* pwd, const char* dbName, int connSize) {
+                       const char* pwd, const char* dbName, int connSize,
+                       int maxConnSize, int acquireTimeoutMs, int checkIntervalMs, int idleTimeoutMs) {
     assert(connSize > 0);
+    host_ = host;
+    port_ = port;
+    user_ = user;
+    pwd_ = pwd;
+    dbName_ = dbName;
+    minConn_ = connSize;
+    maxConn_ = maxConnSize > 0 ? std::max(maxConnSize, connSize) : 2 * connSize;
+    acquireTimeoutMs_ = acquireTimeoutMs;
+    checkIntervalMs_ = checkIntervalMs;
+    idleTimeoutMs_ = idleTimeoutMs;
+
+    // 先建立 minConn 个连接，建立失败的由后台线程补上
     for (int i = 0; i < connSize; ++i) {
-        MYSQL* conn = nullptr;
-        conn = mysql_init(conn);
+        MYSQL* conn = Connect_();
+        if (!conn) continue;
+        std::lock_guard<std::mutex> locker(mtx_);
+        int64_t now = CoarseClock::NowMs();
+        idle_.push_back({conn, now, now});
+        total_++;
+    }
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        closed_ = false;
+    }
+    checker_ = std::thread(&SqlConnPool::HealthCheck_, this);
+}
 
-        if (!conn) {
-            LOG_ERROR("mysql_init error!");
-            assert(conn);
-        }
+MYSQL* SqlConnPool::Connect_() {
+    MYSQL* conn = mysql_init(nullptr);
+    if (!conn) {
+        LOG_ERROR("mysql_init error!");
+        return nullptr;
+    }
+    if (!mysql_real_connect(conn, host_.c_str(), user_.c_str(), pwd_.c_str(), dbName_.c_str(), port_, nullptr, 0)) {
+        LOG_ERROR("mysql_real_connect error: %s", mysql_error(conn));
+        mysql_close(conn);
+        return nullptr;
+    }
+    // 语句只在建立连接时解析一次，之后每次执行只传参数
+    std::vector<MYSQL_STMT*> stmts;
+    for (int id = 0; id < STMT_NUM; id++) {
+        stmts.push_back(Prepare(conn, StmtSql(id).c_str()));
+    }
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        stmts_[conn] = std::move(stmts);
+    }
+    created_.fetch_add(1, std::memory_order_relaxed);
+    return conn;
+}
 
-        conn = mysql_real_connect(conn, host, user, pwd, dbName, port, nullptr, 0);
-        if (!conn) {
-            LOG_ERROR("mysql_real_connect error!");
+void SqlConnPool::Disconnect_(MYSQL* conn) {
+    std::vector<MYSQL_STMT*> stmts;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        auto it = stmts_.find(conn);
+        if (it != stmts_.end()) {
+            stmts.swap(it->second);
+            stmts_.erase(it);
         }
-        connQue_.emplace(conn);
     }
-    MAX_CONN_ = connSize;
-    sem_init(&semId_, 0, MAX_CONN_);
+    for (MYSQL_STMT* stmt : stmts) {
+        if (stmt) mysql_stmt_close(stmt);
+    }
+    mysql_close(conn);
 }
 
 MYSQL* SqlConnPool::GetConn() {
-    MYSQL* conn = nullptr;
-    if (connQue_.empty()) {
-        LOG_WARN("SqlConnPool busy!");
+    return GetConn(acquireTimeoutMs_);
+}
+
+// 有空闲连接就取最近放回的（最可能还活着）；没有的话没到上限就新建，到了上限就等到超时
+MYSQL* SqlConnPool::GetConn(int timeoutMs) {
+    auto begin = std::chrono::steady_clock::now();
+    auto deadline = begin + std::chrono::milliseconds(timeoutMs < 0 ? 0 : timeoutMs);
+    std::unique_lock<std::mutex> locker(mtx_);
+    while (!closed_) {
+        if (!idle_.empty()) {
+            MYSQL* conn = idle_.back().conn;
+            idle_.pop_back();
+            inUse_++;
+            int util = total_ > 0 ? inUse_ * 10 / total_ : 10;
+            locker.unlock();
+            utilHist_[std::min(util, UTIL_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+            Record_(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - begin).count());
+            return conn;
+        }
+        if (total_ < maxConn_) {
+            total_++;           // 先占住名额，建立连接时不持有锁
+            locker.unlock();
+            MYSQL* conn = Connect_();
+            locker.lock();
+            if (conn) {
+                inUse_++;
+                int util = inUse_ * 10 / total_;
+                int total = total_;     // 解锁后 total_ 可能被别的线程和健康检查线程修改，日志用锁内的副本
+                locker.unlock();
+                utilHist_[std::min(util, UTIL_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+                Record_(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - begin).count());
+                LOG_INFO("SqlConnPool grow to %d", total);
+                return conn;
+            }
+            total_--;           // 数据库连不上，和连接池满一样等别人放回
+        }
+        if (timeoutMs < 0) {
+            cond_.wait(locker);
+        }
+        else if (cond_.wait_until(locker, deadline) == std::cv_status::timeout) {
+            if (!idle_.empty()) continue;       // 超时的同时刚好有连接放回
+            break;
+        }
+    }
+    locker.unlock();
+    timeouts_.fetch_add(1, std::memory_order_relaxed);
+    LOG_WARN("SqlConnPool busy! wait %d ms timeout", timeoutMs);
+    return nullptr;
+}
+
+void SqlConnPool::Record_(int64_t waitUs) {
+    int bucket = 0;
+    while (bucket < WAIT_BUCKETS - 1 && waitUs >= (int64_t(1) << bucket)) bucket++;
+    waitHist_[bucket].fetch_add(1, std::memory_order_relaxed);
+    acquired_.fetch_add(1, std::memory_order_relaxed);
+}
+
+MYSQL_STMT* SqlConnPool::Prepare(MYSQL* conn, const char* sql) {
+    MYSQL_STMT* stmt = mysql_stmt_init(conn);
+    if (!stmt) {
+        LOG_ERROR("mysql_stmt_init error!");
         return nullptr;
     }
-    sem_wait(&semId_);
-    {
-        std::lock_guard<std::mutex> locker(mtx_);
-        conn = connQue_.front();
-        connQue_.pop();
+    if (mysql_stmt_prepare(stmt, sql, strlen(sql))) {
+        LOG_ERROR("mysql_stmt_prepare error: %s (%s)", mysql_stmt_error(stmt), sql);
+        mysql_stmt_close(stmt);
+        return nullptr;
     }
-    return conn;
+    return stmt;
+}
+
+MYSQL_STMT* SqlConnPool::GetStmt(MYSQL* conn, SqlStmt id) {
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto it = stmts_.find(conn);
+    if (it == stmts_.end()) return nullptr;
+    return it->second[id];
 }
 
 // 将数据库连接归还到连接池
-void SqlConnPool::FreeConn(MYSQL* conn) {
+void SqlConnPool::FreeConn(MYSQL* conn, bool broken) {
     assert(conn);
-    std::lock_guard<std::mutex> locker(mtx_);
-    connQue_.emplace(conn);
-    sem_post(&semId_);
+    if (broken) {
+        LOG_WARN("SqlConnPool drop broken connection: %s", mysql_error(conn));
+        broken_.fetch_add(1, std::memory_order_relaxed);
+    }
+    bool drop;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        inUse_--;
+        drop = broken || closed_;       // 连接池已经关闭的也直接关掉
+        if (drop) {
+            total_--;
+        }
+        else {
+            int64_t now = CoarseClock::NowMs();
+            idle_.push_back({conn, now, now});
+        }
+    }
+    if (drop) {
+        Disconnect_(conn);
+    }
+    cond_.notify_one();     // 放回了一个连接，或者腾出了一个新建的名额
+}
+
+// 后台线程：每隔 checkIntervalMs 检查一遍空闲连接
+// 空闲超过检查间隔的先 ping 一下，断了就重连，重连不上就丢掉；比 minConn 多出来并且空闲超过 idleTimeoutMs 的关掉
+void SqlConnPool::HealthCheck_() {
+    uint64_t lastAcquired = 0;
+    std::unique_lock<std::mutex> locker(mtx_);
+    while (!closed_) {
+        checkCond_.wait_for(locker, std::chrono::milliseconds(checkIntervalMs_));
+        if (closed_) break;
+
+        int64_t now = CoarseClock::NowMs();
+        std::vector<IdleConn> toCheck;
+        std::vector<MYSQL*> toClose;
+        for (auto it = idle_.begin(); it != idle_.end(); ) {
+            if (total_ - static_cast<int>(toClose.size()) > minConn_ && now - it->sinceMs >= idleTimeoutMs_) {
+                toClose.push_back(it->conn);
+                it = idle_.erase(it);
+            }
+            else if (now - it->checkedMs >= checkIntervalMs_) {
+                toCheck.push_back(*it);
+                it = idle_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        total_ -= toClose.size();
+        int missing = minConn_ - total_;
+        if (missing > 0) total_ += missing;     // 启动时没连上的或者被丢掉的，补到 minConn
+        locker.unlock();
+
+        uint64_t acquired = acquired_.load(std::memory_order_relaxed);
+        if (acquired != lastAcquired) {         // 有人用过才记一次统计
+            lastAcquired = acquired;
+            LOG_INFO("SqlConnPool %s", StatsString().c_str());
+        }
+        for (MYSQL* conn : toClose) {
+            Disconnect_(conn);
+        }
+        if (!toClose.empty()) LOG_INFO("SqlConnPool shrink %d idle connections", (int)toClose.size());
+
+        // 检查期间这些连接既不空闲也不算使用中，只算在 total_ 里
+        std::vector<IdleConn> alive;
+        int lost = 0;
+        for (IdleConn& c : toCheck) {
+            c.checkedMs = CoarseClock::NowMs();
+            if (mysql_ping(c.conn) == 0) {
+                alive.push_back(c);
+                continue;
+            }
+            LOG_WARN("SqlConnPool ping failed: %s, reconnect", mysql_error(c.conn));
+            broken_.fetch_add(1, std::memory_order_relaxed);
+            Disconnect_(c.conn);
+            c.conn = Connect_();
+            if (c.conn) alive.push_back(c);
+            else lost++;
+        }
+        for (int i = 0; i < missing; i++) {
+            MYSQL* conn = Connect_();
+            int64_t t = CoarseClock::NowMs();
+            if (conn) alive.push_back({conn, t, t});
+            else lost++;
+        }
+
+        locker.lock();
+        total_ -= lost;
+        for (const IdleConn& c : alive) {
+            idle_.push_front(c);        // 放在最久没用的一端，空闲连接还是按放回时间排列
+        }
+        if (!alive.empty()) cond_.notify_all();
+    }
 }
 
 void SqlConnPool::ClosePool() {
-    std::lock_guard<std::mutex> locker(mtx_);
-    while (!connQue_.empty()) {
-        auto conn = connQue_.front();
-        connQue_.pop();
-        mysql_close(conn);
+    std::deque<IdleConn> idle;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        if (closed_ && !checker_.joinable() && idle_.empty()) return;
+        closed_ = true;
+        idle.swap(idle_);
+        total_ -= idle.size();
+    }
+    checkCond_.notify_all();
+    cond_.notify_all();
+    if (checker_.joinable()) checker_.join();
+    for (auto& c : idle) {
+        Disconnect_(c.conn);
     }
     mysql_library_end();        // 释放整个 MySQL 客户端库的资源
 }
 
 int SqlConnPool::GetFreeConnCount() {
     std::lock_guard<std::mutex> locker(mtx_);
-    return connQue_.size();
-}
\ No newline at end of file
+    return idle_.size();
+}
+
+SqlConnPool::Stats SqlConnPool::GetStats() {
+    Stats s;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        s.total = total_;
+        s.idle = idle_.size();
+        s.inUse = inUse_;
+        s.maxConn = maxConn_;
+    }
+    s.acquired = acquired_.load(std::memory_order_relaxed);
+    s.timeouts = timeouts_.load(std::memory_order_relaxed);
+    s.created = created_.load(std::memory_order_relaxed);
+    s.broken = broken_.load(std::memory_order_relaxed);
+    for (int i = 0; i < WAIT_BUCKETS; i++) s.waitHist[i] = waitHist_[i].load(std::memory_order_relaxed);
+    for (int i = 0; i < UTIL_BUCKETS; i++) s.utilHist[i] = utilHist_[i].load(std::memory_order_relaxed);
+    return s;
+}
+
+// 一行文本，方便写日志：wait 的第 i 个桶是 [2^(i-1), 2^i) 微秒
+std::string SqlConnPool::StatsString() {
+    Stats s = GetStats();
+    std::ostringstream os;
+    os << "total=" << s.total << " idle=" << s.idle << " inUse=" << s.inUse << " max=" << s.maxConn
+       << " acquired=" << s.acquired << " timeouts=" << s.timeouts
+       << " created=" << s.created << " broken=" << s.broken << " wait_us[";
+    for (int i = 0; i < WAIT_BUCKETS; i++) os << (i ? "," : "") << s.waitHist[i];
+    os << "] util_10pct[";
+    for (int i = 0; i < UTIL_BUCKETS; i++) os << (i ? "," : "") << s.utilHist[i];
+    os << "]";
+    return os.str();
+}
@@ -2,39 +2,118 @@
 #define SQLCONNPOOL_H
 
 #include <mysql/mysql.h>
-#include <semaphore.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <string>
-#include <queue>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "../log/Log.h"
 
+// 每个连接上预编译好的语句，建立连接时创建，连接关闭时一起释放
+enum SqlStmt {
+    STMT_QUERY_USER,        // SELECT password FROM user WHERE username=?
+    STMT_INSERT_USER,       // INSERT INTO user(username, password) VALUES(?, ?)
+    STMT_INSERT_USER_BATCH, // 同上，一次插入 INSERT_BATCH_ROWS 行
+    STMT_NUM,
+};
+
+const int INSERT_BATCH_ROWS = 16;   // 注册批量写入时一条 INSERT 最多的行数
+
+/*
+ * 弹性的数据库连接池
+ * - 连接数在 [minConn, maxConn] 之间：没有空闲连接时先新建，到了上限才排队；
+ * - 取连接带超时，等不到返回 nullptr，数据库一慢请求只会有限地排队，不会一直卡住；
+ * - 后台线程定期 ping 空闲连接，断了的重连，空闲太久的多余连接关掉；
+ * - 用的时候发现连接已经断开（SqlConnRAII 析构时检查错误码）直接丢弃，需要时再新建；
+ * - 记录取连接的等待时间和取连接时的使用率直方图，GetStats() 导出。
+ */
 class SqlConnPool {
 public:
+    static const int WAIT_BUCKETS = 16;     // 等待时间按 2 的幂分桶：<1us, <2us, ... , >=16ms
+    static const int UTIL_BUCKETS = 11;     // 使用率按 10% 分桶：0%, 10%, ... , 100%
+
+    struct Stats {
+        int total;              // 当前连接数（含使用中的）
+        int idle;
+        int inUse;
+        int maxConn;
+        uint64_t acquired;      // 成功取到连接的次数
+        uint64_t timeouts;      // 等待超时的次数
+        uint64_t created;       // 新建（含重连）的连接数
+        uint64_t broken;        // 发现断开被丢弃的连接数
+        uint64_t waitHist[WAIT_BUCKETS];
+        uint64_t utilHist[UTIL_BUCKETS];
+    };
+
     static SqlConnPool* Instance();
 
-    MYSQL* GetConn();
-    void FreeConn(MYSQL* conn);
+    MYSQL* GetConn();                       // 用 Init 设置的超时时间
+    MYSQL* GetConn(int timeoutMs);          // timeoutMs < 0 表示一直等
+    void FreeConn(MYSQL* conn, bool broken = false);    // broken：连接已经不可用，关掉而不是放回
     int GetFreeConnCount();
+    int MaxConnCount() const { return maxConn_; }
+
+    // conn 上预编译的语句，预编译失败时返回 nullptr
+    MYSQL_STMT* GetStmt(MYSQL* conn, SqlStmt id);
+    static MYSQL_STMT* Prepare(MYSQL* conn, const char* sql);     // 临时预编译，调用者负责 mysql_stmt_close
+    static std::string InsertUserSql(int rows);                 // rows 行的 INSERT INTO user 语句
 
     void Init(const char* host, int port, const char* user,
-              const char* pwd, const char* dbName, int connSize);
+              const char* pwd, const char* dbName, int connSize,
+              int maxConnSize = 0, int acquireTimeoutMs = 1000,
+              int checkIntervalMs = 5000, int idleTimeoutMs = 60000);     // maxConnSize 为 0 时取 connSize 的两倍
     void ClosePool();
 
+    Stats GetStats();
+    std::string StatsString();
+
 private:
     SqlConnPool() = default;
     ~SqlConnPool() { ClosePool();}
 
-    int MAX_CONN_;
+    struct IdleConn {
+        MYSQL* conn;
+        int64_t sinceMs;        // 放回连接池的时间
+        int64_t checkedMs;      // 上次放回或者 ping 的时间
+    };
+
+    MYSQL* Connect_();                      // 建立连接并预编译语句，失败返回 nullptr
+    void Disconnect_(MYSQL* conn);          // 释放语句并关闭连接
+    void HealthCheck_();                    // 后台线程：ping 空闲连接、重连、收缩
+    void Record_(int64_t waitUs);           // 记录一次取连接
+
+    std::string host_, user_, pwd_, dbName_;
+    int port_ = 0;
+    int minConn_ = 0;
+    int maxConn_ = 0;
+    int acquireTimeoutMs_ = 1000;
+    int checkIntervalMs_ = 5000;
+    int idleTimeoutMs_ = 60000;
 
-    std::queue<MYSQL*> connQue_;
     std::mutex mtx_;
-    sem_t semId_;
+    std::condition_variable cond_;          // 有连接放回或者可以新建时通知
+    std::deque<IdleConn> idle_;             // 尾部是最近放回的
+    int total_ = 0;                         // 已经建立（或正在建立）的连接数
+    int inUse_ = 0;
+    std::unordered_map<MYSQL*, std::vector<MYSQL_STMT*>> stmts_;     // 连接 -> 预编译语句，下标为 SqlStmt
+
+    bool closed_ = true;
+    std::condition_variable checkCond_;
+    std::thread checker_;
+
+    std::atomic<uint64_t> acquired_{0}, timeouts_{0}, created_{0}, broken_{0};
+    std::atomic<uint64_t> waitHist_[WAIT_BUCKETS] = {};
+    std::atomic<uint64_t> utilHist_[UTIL_BUCKETS] = {};
 };
 
 // RAII的设计，构造函数中获取连接，析构函数中释放连接
 // 确保在对象的生命周期结束时及时释放数据库连接，避免资源泄漏
+// 析构时如果连接报告的是断线错误，就让连接池丢弃它
 class SqlConnRAII {
 public:
     SqlConnRAII(MYSQL** sql, SqlConnPool* connPool) {
@@ -45,7 +124,10 @@ public:
     }
 
     ~SqlConnRAII() {
-        if (sql_) { connPool_->FreeConn(sql_); }
+        if (sql_) {
+            unsigned int err = mysql_errno(sql_);
+            connPool_->FreeConn(sql_, err == 2006 || err == 2013);   // CR_SERVER_GONE_ERROR、CR_SERVER_LOST
+        }
     }
 
 private:
@@ -53,4 +135,4 @@ private:
     SqlConnPool* connPool_;
 };
 
-#endif // SQLCONNPOOL_H
\ No newline at end of file
+#endif // SQLCONNPOOL_H
@@ -0,0 +1,113 @@
+#ifndef TASK_H
+#define TASK_H
+
+/*
+ * 线程池的任务类型，代替 std::function<void()>。
+ * 不超过 INLINE_SIZE 字节的可调用对象（例如捕获几个指针的 lambda）直接放在对象内部，
+ * 提交和执行任务都不需要堆分配；更大的对象才退回到 new。只能移动，不能拷贝。
+ */
+
+#include <assert.h>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+class Task {
+public:
+    static const size_t INLINE_SIZE = 48;
+
+    Task() : ops_(nullptr) {}
+
+    template<class F, class = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f) {
+        typedef typename std::decay<F>::type Fn;
+        Construct_<Fn>(std::forward<F>(f), std::integral_constant<bool, IsInline_<Fn>()>());
+    }
+
+    Task(Task&& other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(&storage_, &other.storage_);
+            other.ops_ = nullptr;       // move 已经析构（或者转交）了 other 中的对象，不能再 destroy
+        }
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            Reset_();
+            ops_ = other.ops_;
+            if (ops_) {
+                ops_->move(&storage_, &other.storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { Reset_(); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void operator()() {
+        assert(ops_);
+        ops_->invoke(&storage_);
+    }
+
+private:
+    typedef typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type Storage;
+
+    struct Ops {
+        void (*invoke)(Storage*);
+        void (*move)(Storage* dst, Storage* src);   // 把 src 中的对象移到 dst，并析构 src 中的对象（大对象只转交指针），之后 src 不再有效
+        void (*destroy)(Storage*);
+    };
+
+    template<class Fn>
+    static constexpr bool IsInline_() {
+        return sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(Storage)
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    // 小对象：直接构造在 storage_ 中
+    template<class Fn, class F>
+    void Construct_(F&& f, std::true_type) {
+        static const Ops ops = {
+            [](Storage* s) { (*reinterpret_cast<Fn*>(s))(); },
+            [](Storage* dst, Storage* src) {
+                new (dst) Fn(std::move(*reinterpret_cast<Fn*>(src)));
+                reinterpret_cast<Fn*>(src)->~Fn();
+            },
+            [](Storage* s) { reinterpret_cast<Fn*>(s)->~Fn(); },
+        };
+        new (&storage_) Fn(std::forward<F>(f));
+        ops_ = &ops;
+    }
+
+    // 大对象：storage_ 中只存一个指针
+    template<class Fn, class F>
+    void Construct_(F&& f, std::false_type) {
+        static const Ops ops = {
+            [](Storage* s) { (**reinterpret_cast<Fn**>(s))(); },
+            [](Storage* dst, Storage* src) { *reinterpret_cast<Fn**>(dst) = *reinterpret_cast<Fn**>(src); },
+            [](Storage* s) { delete *reinterpret_cast<Fn**>(s); },
+        };
+        *reinterpret_cast<Fn**>(&storage_) = new Fn(std::forward<F>(f));
+        ops_ = &ops;
+    }
+
+    void Reset_() {
+        if (ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    Storage storage_;
+    const Ops* ops_;
+};
+
+#endif // TASK_H
@@ -2,76 +2,185 @@
 #define THREAD_POOL
 
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
-#include <queue>
+#include <memory>
 #include <vector>
-#include <functional>
 
+#include "Task.h"
+#include "MpmcQueue.h"
+
+/*
+ * 工作窃取线程池
+ * - 每个工作线程有自己的无锁本地队列，外部提交的任务轮流分到各个本地队列，生产者之间、消费者之间不再争同一把锁；
+ * - 本地队列满了就放进全局注入队列；
+ * - 工作线程依次从 本地队列 -> 注入队列 -> 其他线程的本地队列（窃取）取任务；
+ * - 取不到任务时先自旋一会儿，再让出 CPU，最后才在条件变量上休眠，只有目标线程在休眠时提交任务才需要加锁唤醒。
+ *
+ * 亲和模式（affinity）：AddTask(key, f) 按 key 固定投递到某个工作线程，且不做窃取，
+ * 同一个 key 的任务总是在同一个线程上按提交顺序执行；pinCpu 时工作线程 i 还会绑定到 CPU i % 核数。
+ */
 class ThreadPool{
 public:
-    ThreadPool() = default;
-    ThreadPool(ThreadPool&&) = default;
-    ThreadPool(int numThreads = 8) : isClosed_(false) {
+    explicit ThreadPool(int numThreads = 8, size_t queueCapacity = 1024,
+                        bool affinity = false, bool pinCpu = false)
+            : global_(queueCapacity), next_(0), sleeping_(0), isClosed_(false), affinity_(affinity) {
         assert(numThreads > 0);
         for (int i = 0; i < numThreads; i++) {
-            threads_.emplace_back([this] {
-                while (true) {
-                    std::unique_lock<std::mutex> lock(mtx_);
-
-                    // 等待，判断是否有新的任务需要执行，如果线程池已经关闭且任务队列为空，则退出线程
-                    condition_.wait(lock, [this] {              
-                        return !tasks_.empty() || isClosed_;
-                    });
-
-                    if (isClosed_ && tasks_.empty()) {
-                        return;
-                    }
-
-                    std::function<void()> task (std::move(tasks_.front()));
-                    tasks_.pop();
-                    lock.unlock();  // 任务已经取出来了，所以提前解锁，让其他线程可以继续添加任务
-                    task();
-                }
-            });
+            workers_.emplace_back(new Worker(queueCapacity));
+        }
+        for (int i = 0; i < numThreads; i++) {
+            workers_[i]->thread = std::thread([this, i] { WorkerLoop_(i); });
+            if (pinCpu) {
+                PinCpu_(workers_[i]->thread, i);
+            }
         }
     }
 
     ~ThreadPool() {
-        {
-            std::unique_lock<std::mutex> lock(mtx_);
-            isClosed_ = true;
+        isClosed_.store(true);
+
+        // 通知所有等待的线程线程池已经关闭,join()等待所有线程把剩下的任务做完后结束。
+        for (auto& w : workers_) {
+            { std::lock_guard<std::mutex> lock(w->mtx); }
+            w->condition.notify_all();
         }
+        for (auto& w : workers_) {
+            w->thread.join();
+        }
+    }
+
+    // 不指定线程：轮流放进各个工作线程的本地队列
+    template<class F>
+    void AddTask(F&& f) {
+        Push_(next_.fetch_add(1, std::memory_order_relaxed), Task(std::forward<F>(f)));
+    }
+
+    // 指定 key：亲和模式下同一个 key 总是交给同一个工作线程，否则只是优先放进这个线程的队列
+    template<class F>
+    void AddTask(size_t key, F&& f) {
+        Push_(key, Task(std::forward<F>(f)));
+    }
+
+    size_t ThreadCount() const { return workers_.size(); }
+    bool IsAffinity() const { return affinity_; }
+
+private:
+    struct Worker {
+        explicit Worker(size_t capacity) : local(capacity), sleeping(false) {}
+        MpmcQueue<Task> local;      // 本地队列，非亲和模式下其他线程空闲时也会来这里窃取
+        std::thread thread;
+
+        std::atomic<bool> sleeping; // 每个线程单独休眠，亲和模式下才能准确唤醒目标线程
+        std::mutex mtx;
+        std::condition_variable condition;
+    };
+
+    static const int SPIN_COUNT = 64;       // 休眠前自旋尝试的次数
+    static const int YIELD_COUNT = 16;      // 自旋之后再让出 CPU 尝试的次数
 
-        // 通知所有等待的线程线程池已经关闭,join()等待所有线程结束。
-        condition_.notify_all();
-        for (auto& t : threads_){
-            t.join();
+    static void PinCpu_(std::thread& t, int index) {
+        int cpus = std::thread::hardware_concurrency();
+        if (cpus <= 0) return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cpus, &set);
+        pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);   // 失败时只是不绑核，不影响正确性
+    }
+
+    void Push_(size_t key, Task&& task) {
+        size_t index = key % workers_.size();
+        Worker& w = *workers_[index];
+        // 本地队列满了：非亲和模式放注入队列，亲和模式只能等目标线程腾出位置，全都满了就让出 CPU
+        while (!w.local.TryPush(std::move(task))) {
+            if (!affinity_ && global_.TryPush(std::move(task))) break;
+            Wake_(w);
+            std::this_thread::yield();
+        }
+        // 和工作线程登记休眠的 seq_cst 配对：要么这里看到线程在休眠，要么休眠线程看到刚放进去的任务
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed) == 0) return;
+        if (Wake_(w) || affinity_) return;
+        // 目标线程醒着，随便叫醒一个休眠的线程来帮忙
+        for (size_t i = 1; i < workers_.size(); i++) {
+            if (Wake_(*workers_[(index + i) % workers_.size()])) return;
+        }
+    }
+
+    bool Wake_(Worker& w) {
+        if (!w.sleeping.load(std::memory_order_seq_cst)) return false;
+        { std::lock_guard<std::mutex> lock(w.mtx); }
+        w.condition.notify_one();       // 通知等待的线程有新任务可以执行
+        return true;
+    }
+
+    void WorkerLoop_(size_t index) {
+        Worker& w = *workers_[index];
+        Task task;
+        while (true) {
+            if (TryGet_(index, task) || Spin_(index, task)) {
+                task();
+                task = Task();      // 及时析构任务捕获的对象
+                continue;
+            }
+
+            // 休眠：先登记，再检查一次队列，避免和提交任务的线程错过唤醒
+            std::unique_lock<std::mutex> lock(w.mtx);
+            sleeping_.fetch_add(1, std::memory_order_seq_cst);
+            w.sleeping.store(true, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!isClosed_ && !HasTask_(index)) {
+                w.condition.wait(lock);
+            }
+            w.sleeping.store(false, std::memory_order_relaxed);
+            sleeping_.fetch_sub(1, std::memory_order_relaxed);
+            if (isClosed_ && !HasTask_(index)) {
+                return;     // 线程池已经关闭且任务都做完了，退出线程
+            }
         }
     }
 
-    template<class F, class... Args>
-    void AddTask(F&& f, Args&&... args){
-        // 将函数f和其参数args...绑定到task上
-        std::function<void()> task = std::bind(std::forward<F>(f), std::forward(args)...);
-        
-        {
-            std::unique_lock<std::mutex> lock(mtx_);
-            tasks_.emplace(std::move(task));        // 添加到任务队列中
+    // 本地队列 -> 注入队列 -> 从其他线程的本地队列窃取，亲和模式下只取本地队列
+    bool TryGet_(size_t index, Task& task) {
+        if (workers_[index]->local.TryPop(task)) return true;
+        if (affinity_) return false;
+        if (global_.TryPop(task)) return true;
+        size_t n = workers_.size();
+        for (size_t i = 1; i < n; i++) {
+            if (workers_[(index + i) % n]->local.TryPop(task)) return true;
         }
+        return false;
+    }
 
-        condition_.notify_one();        // 通知等待的线程有新任务可以执行，唤醒一个程序
+    bool Spin_(size_t index, Task& task) {
+        for (int i = 0; i < SPIN_COUNT + YIELD_COUNT; i++) {
+            if (i >= SPIN_COUNT) std::this_thread::yield();
+            if (TryGet_(index, task)) return true;
+        }
+        return false;
     }
 
-private:
-   std::vector<std::thread> threads_;        // 线程数组
-   std::queue<std::function<void()>> tasks_; // 任务队列
+    bool HasTask_(size_t index) const {
+        if (!workers_[index]->local.Empty()) return true;
+        if (affinity_) return false;
+        if (!global_.Empty()) return true;
+        for (auto& w : workers_) {
+            if (!w->local.Empty()) return true;
+        }
+        return false;
+    }
 
-   std::mutex mtx_;
-   std::condition_variable condition_;
+    std::vector<std::unique_ptr<Worker>> workers_;     // 工作线程
+    MpmcQueue<Task> global_;                            // 注入队列
+    std::atomic<size_t> next_;                          // 轮流分配本地队列
 
-   bool isClosed_; 
+    std::atomic<int> sleeping_;                         // 正在休眠的线程数，为 0 时提交任务不用检查唤醒
+    std::atomic<bool> isClosed_;
+    const bool affinity_;
 };
 
-#endif // THREAD_POOL
\ No newline at end of file
+#endif // THREAD_POOL
@@ -0,0 +1,61 @@
+#include "ConnTable.h"
+
+ConnTable::ConnTable(int maxFd) : maxFd_(maxFd),
+        chunks_(new std::atomic<Slot*>[(maxFd + CHUNK_SIZE - 1) >> CHUNK_SHIFT]) {
+    assert(maxFd > 0);
+    int chunkNum = (maxFd_ + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    for (int i = 0; i < chunkNum; i++) {
+        chunks_[i].store(nullptr, std::memory_order_relaxed);
+    }
+    // 小fd最常用，第一块提前分配好，避免第一波连接到来时才花时间构造整块连接
+    chunks_[0].store(new Slot[CHUNK_SIZE], std::memory_order_release);
+}
+
+ConnTable::~ConnTable() {
+    int chunkNum = (maxFd_ + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    for (int i = 0; i < chunkNum; i++) {
+        delete[] chunks_[i].load(std::memory_order_relaxed);
+    }
+}
+
+HttpConn* ConnTable::Acquire(int fd, uint32_t* gen) {
+    if (fd < 0 || fd >= maxFd_) return nullptr;
+    std::atomic<Slot*>& chunk = chunks_[fd >> CHUNK_SHIFT];
+    Slot* slots = chunk.load(std::memory_order_acquire);
+    if (!slots) {
+        // 只有事件循环线程会分配，不存在两个线程同时分配同一块
+        slots = new Slot[CHUNK_SIZE];
+        chunk.store(slots, std::memory_order_release);
+    }
+    Slot& slot = slots[fd & (CHUNK_SIZE - 1)];
+    uint32_t g = slot.gen.load(std::memory_order_relaxed) + 1;
+    slot.gen.store(g, std::memory_order_release);
+    if (gen) *gen = g;
+    return &slot.conn;
+}
+
+HttpConn* ConnTable::Get(int fd) const {
+    Slot* slot = GetSlot_(fd);
+    return slot ? &slot->conn : nullptr;
+}
+
+uint32_t ConnTable::Generation(int fd) const {
+    Slot* slot = GetSlot_(fd);
+    return slot ? slot->gen.load(std::memory_order_acquire) : 0;
+}
+
+uint32_t ConnTable::Armed(int fd) const {
+    Slot* slot = GetSlot_(fd);
+    return slot ? slot->armed.load(std::memory_order_relaxed) : 0;
+}
+
+void ConnTable::SetArmed(int fd, uint32_t events) {
+    Slot* slot = GetSlot_(fd);
+    if (slot) slot->armed.store(events, std::memory_order_relaxed);
+}
+
+ConnTable::Slot* ConnTable::GetSlot_(int fd) const {
+    if (fd < 0 || fd >= maxFd_) return nullptr;
+    Slot* slots = chunks_[fd >> CHUNK_SHIFT].load(std::memory_order_acquire);
+    return slots ? &slots[fd & (CHUNK_SIZE - 1)] : nullptr;
+}
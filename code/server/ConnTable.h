@@ -0,0 +1,63 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+#include "../http/HttpConn.h"
+
+/*
+ * 以 fd 为下标的连接表，代替 unordered_map<int, HttpConn>
+ * - 按 CHUNK_SIZE 个连接一块分配，用到哪块才分配哪块，块内连接连续存放，分配后地址不再变化，
+ *   工作线程手里的 HttpConn* 不会因为插入新连接（rehash）失效；
+ * - 查找就是两次数组下标，不需要哈希；
+ * - 每个槽位有一个代数（generation），fd 每被一个新连接使用一次就加一，
+ *   事件和任务带上提交时的代数，执行时代数对不上就说明是旧连接留下的，直接丢弃。
+ * 只有所属的事件循环线程调用 Acquire，其他线程只读。
+ */
+class ConnTable {
+public:
+    explicit ConnTable(int maxFd = 65536);
+    ~ConnTable();
+
+    ConnTable(const ConnTable&) = delete;
+    ConnTable& operator=(const ConnTable&) = delete;
+
+    // 新连接占用 fd 对应的槽位，代数加一，fd 超出范围时返回 nullptr
+    HttpConn* Acquire(int fd, uint32_t* gen);
+
+    // fd 对应的连接，槽位还没分配过时返回 nullptr
+    HttpConn* Get(int fd) const;
+
+    uint32_t Generation(int fd) const;
+
+    // 事件或任务是否仍然属于 fd 上当前的连接
+    bool IsCurrent(int fd, uint32_t gen) const {
+        return Generation(fd) == gen;
+    }
+
+    // 连接当前在 epoll 里注册的事件，没有 EPOLLONESHOT 时用来跳过和上次相同的 epoll_ctl；只由处理这个连接的线程读写
+    uint32_t Armed(int fd) const;
+    void SetArmed(int fd, uint32_t events);
+
+    int MaxFd() const { return maxFd_; }
+
+private:
+    struct Slot {
+        HttpConn conn;
+        std::atomic<uint32_t> gen{0};
+        std::atomic<uint32_t> armed{0};
+    };
+
+    static const int CHUNK_SHIFT = 10;
+    static const int CHUNK_SIZE = 1 << CHUNK_SHIFT;     // 每块 1024 个连接
+
+    Slot* GetSlot_(int fd) const;
+
+    const int maxFd_;
+    std::unique_ptr<std::atomic<Slot*>[]> chunks_;
+};
+
+#endif // CONN_TABLE_H
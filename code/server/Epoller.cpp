@@ -1,6 +1,7 @@
 #include "Epoller.h"
 
-Epoller::Epoller(int maxEvent) : epollFd_(epoll_create(512)), events_(maxEvent) {
+Epoller::Epoller(int maxEvent) : epollFd_(epoll_create(512)), maxEvent_(maxEvent), sparseRounds_(0),
+        events_(maxEvent < INIT_EVENT ? maxEvent : INIT_EVENT) {
     assert(epollFd_ >= 0 && events_.size() > 0);
 }
 
@@ -8,18 +9,18 @@ Epoller::~Epoller() {
     close(epollFd_);
 }
 
-bool Epoller::AddFd(int fd, uint32_t events) {
+bool Epoller::AddFd(int fd, uint32_t events, uint32_t tag) {
     if (fd < 0) return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = MakeData_(fd, tag);
     ev.events = events;
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
 }
 
-bool Epoller::ModFd(int fd, uint32_t events) {
+bool Epoller::ModFd(int fd, uint32_t events, uint32_t tag) {
     if (fd < 0) return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = MakeData_(fd, tag);
     ev.events = events;
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
 }
@@ -30,12 +31,41 @@ bool Epoller::DelFd(int fd) {
 }
 
 int Epoller::Wait(int timeoutMs) {
-    return epoll_wait(epollFd_, &events_[0], static_cast<int>(events_.size()), timeoutMs);
+    int eventCnt = epoll_wait(epollFd_, &events_[0], static_cast<int>(events_.size()), timeoutMs);
+    if (eventCnt >= 0) Resize_(eventCnt);
+    return eventCnt;
+}
+
+// 扩大时原有的事件被复制过去，缩小时只去掉末尾没有用到的部分，调用者照常读取这次的结果
+void Epoller::Resize_(int eventCnt) {
+    size_t cnt = static_cast<size_t>(eventCnt);
+    if (cnt == events_.size()) {
+        sparseRounds_ = 0;
+        if (events_.size() < maxEvent_) {
+            events_.resize(events_.size() * 2 < maxEvent_ ? events_.size() * 2 : maxEvent_);
+        }
+    }
+    else if (cnt * 4 < events_.size() && events_.size() > static_cast<size_t>(MIN_EVENT)) {
+        if (++sparseRounds_ >= SHRINK_ROUNDS) {
+            sparseRounds_ = 0;
+            size_t half = events_.size() / 2;
+            events_.resize(half > static_cast<size_t>(MIN_EVENT) ? half : MIN_EVENT);
+            events_.shrink_to_fit();
+        }
+    }
+    else {
+        sparseRounds_ = 0;
+    }
 }
 
 int Epoller::GetEventFd(size_t i) const {
     assert(i < events_.size() && i >= 0);
-    return events_[i].data.fd;
+    return static_cast<int>(static_cast<uint32_t>(events_[i].data.u64));
+}
+
+uint32_t Epoller::GetEventTag(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return static_cast<uint32_t>(events_[i].data.u64 >> 32);
 }
 
 uint32_t Epoller::GetEvents(size_t i) const {
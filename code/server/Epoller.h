@@ -7,16 +7,18 @@
 #include <errno.h>
 #include <vector>
 
+// 一次 epoll_wait 最多取回的事件数随负载调整：取满了就翻倍（不超过 maxEvent），
+// 连续 SHRINK_ROUNDS 次不到四分之一就减半（不少于 MIN_EVENT），空闲时数组小，繁忙时一次取回更多
 class Epoller {
 public:
-    explicit Epoller(int maxEvent = 1024);
+    explicit Epoller(int maxEvent = 4096);
     ~Epoller();
 
-    // 向 epoll 实例中添加文件描述符
-    bool AddFd(int fd, uint32_t events);
+    // 向 epoll 实例中添加文件描述符，tag 随事件一起返回（连接用它携带代数）
+    bool AddFd(int fd, uint32_t events, uint32_t tag = 0);
 
     // 修改 epoll 实例中已添加的文件描述符
-    bool ModFd(int fd, uint32_t events);
+    bool ModFd(int fd, uint32_t events, uint32_t tag = 0);
 
     // 从 epoll 实例中删除文件描述符
     bool DelFd(int fd);
@@ -27,11 +29,30 @@ public:
     // 获取第 i 个就绪事件的文件描述符
     int GetEventFd(size_t i) const;
 
+    // 获取第 i 个就绪事件注册时的 tag
+    uint32_t GetEventTag(size_t i) const;
+
     // 获取第 i 个就绪事件的事件类型
     uint32_t GetEvents(size_t i) const;
 
+    // 当前一次最多取回的事件数
+    size_t Capacity() const { return events_.size(); }
+
 private:
+    // data.u64 的低 32 位是 fd，高 32 位是 tag
+    static uint64_t MakeData_(int fd, uint32_t tag) {
+        return (static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    void Resize_(int eventCnt);             // 按这次取回的事件数调整数组大小，不影响这次的结果
+
+    static const int MIN_EVENT = 16;
+    static const int INIT_EVENT = 64;
+    static const int SHRINK_ROUNDS = 64;
+
     int epollFd_; // epoll 实例的文件描述符
+    size_t maxEvent_;
+    int sparseRounds_;                      // 连续取回的事件不到四分之一的次数
     std::vector<struct epoll_event> events_; // 用于存储就绪事件的数组
 };
 
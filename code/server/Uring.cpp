@@ -0,0 +1,256 @@
+#include "Uring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+namespace {
+
+int SysSetup(unsigned entries, struct io_uring_params* p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int SysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+int SysRegister(int fd, unsigned op, void* arg, unsigned nrArgs) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, op, arg, nrArgs));
+}
+
+unsigned LoadAcquire(const unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned* p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// 缓冲区环的第 i 项。头文件里 bufs 是 union 中的柔性数组，g++ 会把它排在偏移 8 处，这里按内核的布局直接算
+struct io_uring_buf* BufAt(struct io_uring_buf_ring* ring, unsigned i) {
+    return reinterpret_cast<struct io_uring_buf*>(ring) + i;
+}
+
+} // namespace
+
+// 多发 recv 要 6.0，这里只看版本号，再实际建一个环确认没有被禁用
+bool Uring::Supported() {
+    struct utsname name;
+    int major = 0, minor = 0;
+    if (uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2) return false;
+    if (major < 6) return false;
+    Uring probe(8, 8, 64);
+    return probe.IsValid();
+}
+
+Uring::Uring(unsigned entries, unsigned bufCount, unsigned bufSize)
+    : ringFd_(-1), ringMem_(MAP_FAILED), ringMemLen_(0), sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)), sqesLen_(0),
+      sqHead_(nullptr), sqTail_(nullptr), sqMask_(0), sqEntries_(0), sqLocalTail_(0), toSubmit_(0),
+      cqHead_(nullptr), cqTail_(nullptr), cqMask_(0), cqRing_(nullptr),
+      bufRing_(nullptr), bufCount_(0), bufSize_(bufSize), bufTail_(0), bufBase_(nullptr) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // 每个连接一个多发 recv，完成事件可能比 SQE 多得多，CQ 开大一些
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = entries * 4;
+    int fd = SysSetup(entries, &p);
+    if (fd < 0) return;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)
+            || !(p.features & IORING_FEAT_NODROP)) {
+        close(fd);
+        return;
+    }
+
+    size_t sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cqLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ringMemLen_ = sqLen > cqLen ? sqLen : cqLen;
+    ringMem_ = mmap(nullptr, ringMemLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    sqesLen_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ringMem_ == MAP_FAILED || sqes == MAP_FAILED) {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesLen_);
+        if (ringMem_ != MAP_FAILED) munmap(ringMem_, ringMemLen_);
+        ringMem_ = MAP_FAILED;
+        close(fd);
+        return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* base = static_cast<char*>(ringMem_);
+    sqHead_ = reinterpret_cast<unsigned*>(base + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+    sqEntries_ = p.sq_entries;
+    sqLocalTail_ = *sqTail_;
+    // SQ 的下标数组固定为 i -> i，SQE 按顺序使用
+    unsigned* array = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) array[i] = i;
+
+    cqHead_ = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+    cqRing_ = reinterpret_cast<struct io_uring_cqe*>(base + p.cq_off.cqes);
+    cqes_.reserve(p.cq_entries);
+
+    ringFd_ = fd;
+    if (!InitBufRing_(bufCount, bufSize)) Release_();
+}
+
+Uring::~Uring() {
+    Release_();
+}
+
+void Uring::Release_() {
+    if (bufRing_) munmap(bufRing_, bufCount_ * sizeof(struct io_uring_buf));
+    bufRing_ = nullptr;
+    free(bufBase_);
+    bufBase_ = nullptr;
+    if (sqes_ != MAP_FAILED) munmap(sqes_, sqesLen_);
+    sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+    if (ringMem_ != MAP_FAILED) munmap(ringMem_, ringMemLen_);
+    ringMem_ = MAP_FAILED;
+    if (ringFd_ >= 0) close(ringFd_);
+    ringFd_ = -1;
+}
+
+// 缓冲区环：count 个 size 字节的缓冲区（count 必须是 2 的幂），注册为第 BUF_GROUP 组
+bool Uring::InitBufRing_(unsigned count, unsigned size) {
+    size_t ringLen = count * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, ringLen, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED) return false;
+    bufRing_ = static_cast<struct io_uring_buf_ring*>(ring);
+    bufCount_ = count;
+    if (posix_memalign(reinterpret_cast<void**>(&bufBase_), 4096, static_cast<size_t>(count) * size) != 0) {
+        bufBase_ = nullptr;
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = count;
+    reg.bgid = BUF_GROUP;
+    if (SysRegister(ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) return false;
+
+    for (unsigned i = 0; i < count; i++) {
+        struct io_uring_buf* buf = BufAt(bufRing_, i);
+        buf->addr = reinterpret_cast<uint64_t>(bufBase_ + static_cast<size_t>(i) * size);
+        buf->len = size;
+        buf->bid = static_cast<uint16_t>(i);
+    }
+    bufTail_ = static_cast<uint16_t>(count);
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+    return true;
+}
+
+void Uring::RecycleBuffer(uint16_t bid) {
+    struct io_uring_buf* buf = BufAt(bufRing_, bufTail_ & (bufCount_ - 1));
+    buf->addr = reinterpret_cast<uint64_t>(bufBase_ + static_cast<size_t>(bid) * bufSize_);
+    buf->len = bufSize_;
+    buf->bid = bid;
+    bufTail_++;
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe* Uring::GetSqe_() {
+    if (sqLocalTail_ - LoadAcquire(sqHead_) >= sqEntries_) {
+        Submit_(0, 0);      // SQ 满了，先把攒下的提交掉
+        if (sqLocalTail_ - LoadAcquire(sqHead_) >= sqEntries_) return nullptr;
+    }
+    struct io_uring_sqe* sqe = &sqes_[sqLocalTail_ & sqMask_];
+    memset(sqe, 0, sizeof(*sqe));
+    sqLocalTail_++;
+    toSubmit_++;
+    return sqe;
+}
+
+bool Uring::AcceptMultishot(int listenFd, uint64_t data) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = data;
+    return true;
+}
+
+bool Uring::RecvMultishot(int fd, uint64_t data) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = data;
+    return true;
+}
+
+bool Uring::SendMsg(int fd, const struct msghdr* msg, uint64_t data) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = data;
+    return true;
+}
+
+bool Uring::PollMultishot(int fd, uint32_t events, uint64_t data) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = data;
+    return true;
+}
+
+// 发布攒下的 SQE，waitNr > 0 时顺便等待完成事件，timeoutMs < 0 时不限时
+int Uring::Submit_(unsigned waitNr, int timeoutMs) {
+    StoreRelease(sqTail_, sqLocalTail_);
+    unsigned toSubmit = toSubmit_;
+    toSubmit_ = 0;
+    unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (waitNr > 0 && timeoutMs >= 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    flags |= IORING_ENTER_EXT_ARG;
+    int ret;
+    do {
+        ret = SysEnter(ringFd_, toSubmit, waitNr, flags, &arg, sizeof(arg));
+    } while (ret < 0 && errno == EINTR && waitNr == 0);
+    return ret;
+}
+
+int Uring::Wait(int timeoutMs) {
+    cqes_.clear();
+    // 已经有完成事件时只提交不等待
+    unsigned ready = LoadAcquire(cqTail_) - *cqHead_;
+    if (toSubmit_ > 0 || ready == 0) {
+        int ret = Submit_(ready == 0 ? 1 : 0, timeoutMs);
+        if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) return -1;
+    }
+    unsigned head = *cqHead_;
+    unsigned tail = LoadAcquire(cqTail_);
+    for (; head != tail; head++) {
+        cqes_.push_back(cqRing_[head & cqMask_]);
+    }
+    StoreRelease(cqHead_, head);
+    return static_cast<int>(cqes_.size());
+}
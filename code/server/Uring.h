@@ -0,0 +1,86 @@
+#ifndef URING_H
+#define URING_H
+
+/*
+ * io_uring 的简单封装（直接用系统调用，不依赖 liburing），只提供 WebServer 用到的几种操作：
+ * - 多发（multishot）accept：一个 SQE 持续接受新连接；
+ * - 多发 recv + 提供缓冲区环（provided buffer ring）：每个连接一个 SQE 持续接收，数据放在内核从环里挑的缓冲区中，
+ *   连接空闲时不占缓冲区，用完由调用者还回去；
+ * - sendmsg：一次发送整批响应（响应头和文件内容多段 iovec）；
+ * - 多发 poll：监听 eventfd，其他线程投递任务时唤醒。
+ * 提交的 SQE 先攒着，Wait() 时和等待完成事件合并成一次 io_uring_enter。
+ * 和 Epoller 一样，完成事件取出后用下标访问，user_data 由调用者编码。
+ */
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <vector>
+
+class Uring {
+public:
+    // 内核是否支持上面这些操作（6.0 以上，并且没有被 io_uring_disabled 禁用）
+    static bool Supported();
+
+    Uring(unsigned entries, unsigned bufCount, unsigned bufSize);
+    ~Uring();
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    bool IsValid() const { return ringFd_ >= 0; }
+
+    bool AcceptMultishot(int listenFd, uint64_t data);
+    bool RecvMultishot(int fd, uint64_t data);         // 从缓冲区环里取缓冲区
+    bool SendMsg(int fd, const struct msghdr* msg, uint64_t data);
+    bool PollMultishot(int fd, uint32_t events, uint64_t data);
+
+    // 提交攒下的 SQE 并等待至少一个完成事件，返回取到的完成事件数，timeoutMs 为 -1 时一直等
+    int Wait(int timeoutMs);
+
+    uint64_t GetData(size_t i) const { return cqes_[i].user_data; }
+    int32_t GetResult(size_t i) const { return cqes_[i].res; }
+    uint32_t GetFlags(size_t i) const { return cqes_[i].flags; }
+    bool HasMore(size_t i) const { return cqes_[i].flags & IORING_CQE_F_MORE; }   // 多发的 SQE 还在继续
+
+    // 第 i 个完成事件使用的缓冲区，数据拷走后用 RecycleBuffer 还给缓冲区环
+    bool HasBuffer(size_t i) const { return cqes_[i].flags & IORING_CQE_F_BUFFER; }
+    uint16_t GetBufferId(size_t i) const { return cqes_[i].flags >> IORING_CQE_BUFFER_SHIFT; }
+    const char* GetBuffer(uint16_t bid) const { return bufBase_ + static_cast<size_t>(bid) * bufSize_; }
+    void RecycleBuffer(uint16_t bid);
+
+private:
+    void Release_();
+    struct io_uring_sqe* GetSqe_();
+    int Submit_(unsigned waitNr, int timeoutMs);
+    bool InitBufRing_(unsigned count, unsigned size);
+
+    static const uint16_t BUF_GROUP = 0;
+
+    int ringFd_;
+    void* ringMem_;             // SQ 和 CQ 共用一次 mmap（IORING_FEAT_SINGLE_MMAP）
+    size_t ringMemLen_;
+    struct io_uring_sqe* sqes_;
+    size_t sqesLen_;
+
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned sqLocalTail_;      // 已经填好还没有发布给内核的 SQE 的位置
+    unsigned toSubmit_;
+
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    struct io_uring_cqe* cqRing_;
+    std::vector<struct io_uring_cqe> cqes_;     // 取出的完成事件，取出后 CQ 的位置立即还给内核
+
+    struct io_uring_buf_ring* bufRing_;
+    unsigned bufCount_;
+    unsigned bufSize_;
+    uint16_t bufTail_;
+    char* bufBase_;
+};
+
+#endif // URING_H
@@ -2,77 +2,173 @@
 
 WebServer::WebServer(int port, int trigMode, int timeoutMS,
                     int sqlPort, const char* sqlUser, const char* sqlPwd, const char* dbName, 
-                    int connPoolNum, int threadNum, bool openLog, int logLevel, int logQueSize) : 
-                        port_(port), timeoutMS_(timeoutMS), isClose_(false), 
-                        timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller()){
+                    int connPoolNum, int threadNum, bool openLog, int logLevel, int logQueSize,
+                    int reactorNum, bool zeroCopy, int affinity,
+                    bool deferredLog, int traceSample, bool ioUring) : 
+                        port_(port), timeoutMS_(timeoutMS), isClose_(false),
+                        reactorNum_(reactorNum), ioUring_(false), affinity_(reactorNum > 0 ? 0 : affinity) {
+    assert(reactorNum >= 0);
+    // io_uring 只接管多Reactor模式的事件循环；单Reactor模式的读写在线程池里，仍然用 epoll
+    ioUring_ = ioUring && reactorNum_ > 0 && Uring::Supported();
     
     /* 日志系统 */
     if (openLog) {
-        Log::Instance()->init(logLevel, "./log", ".log", logQueSize);
+        Log::Instance()->init(logLevel, "./log", ".log", logQueSize, deferredLog);
         if (isClose_) { LOG_ERROR(" ========== Server Init Error! ========== "); }
         else {
             LOG_INFO(" ========== Server Init! ========== ");
             LOG_INFO("Listen Mode: %s, Open Linger: %s", 
                         (listenEvent_ & EPOLLET ? "ET" : "LT"),
                         (connEvent_ & EPOLLET ? "ET" : "LT"));
-            LOG_INFO("LogSys level : %d", logLevel);
+            LOG_INFO("LogSys level : %d, Deferred format: %s", logLevel, Log::Instance()->IsDeferred() ? "on" : "off");
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
             LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("Reactor num: %d, Zero copy: %s, Affinity: %d", reactorNum, zeroCopy ? "on" : "off", affinity_);
+            LOG_INFO("I/O backend: %s", ioUring_ ? "io_uring" : "epoll");
+            if (ioUring && !ioUring_) {
+                LOG_WARN("io_uring needs multi-Reactor mode and Linux 6.0+, fall back to epoll");
+            }
         }
     }
 
+    // 按请求的阶段追踪，每 traceSample 个请求抽一个，收到 SIGUSR2 时导出到 ./log
+    Tracer::Instance()->Init(traceSample, "./log");
+
     srcDir_ = getcwd(nullptr, 256);
     assert(srcDir_);
     strcat(srcDir_, "/resources/");
     HttpConn::userCount = 0;
     HttpConn::srcDir = srcDir_;
+    // io_uring 后端整批响应用一次 sendmsg 发出，文件内容要在内存里（mmap 或文件缓存），不走 sendfile
+    HttpResponse::zeroCopy = zeroCopy && !ioUring_;
+    FileCache::Instance()->Init(srcDir_);     // 静态文件缓存，小文件命中后不再 stat/open
+    CredentialCache::Instance()->Init();     // 登录成功的用户缓存一分钟，反复登录不再查数据库
 
     /* 初始化操作 */
     // 连接池单例的初始化
     SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
+    // 每个数据库线程执行时占用一个连接，线程数和连接池的上限相同，排队多了连接池才会扩容
+    dbExecutor_.reset(new DbExecutor(SqlConnPool::Instance()->MaxConnCount()));
+    // 查重通过的注册攒成多行 INSERT 由一个写线程写入
+    registerBatcher_.reset(new RegisterBatcher());
+    // /__metrics 导出时附带的瞬时状态
+    Metrics::Instance()->SetCollector([this](std::string& out) { CollectMetrics_(out); });
     // 初始化事件和初始化socket（监听）
     InitEventMode_(trigMode);
-    if (!InitSocket_()) { isClose_ = true; }
 
+    // 单Reactor：主线程一个事件循环 + 线程池读写；多Reactor：每个线程一个事件循环，读写就地完成
+    int loopNum = reactorNum_ > 0 ? reactorNum_ : 1;
+    if (reactorNum_ == 0) {
+        threadpool_.reset(new ThreadPool(threadNum, 1024, affinity_ > 0, affinity_ > 1));
+    }
+    for (int i = 0; i < loopNum; i++) {
+        std::unique_ptr<Reactor> loop(new Reactor);
+        loop->timer.reset(new LoopTimer());
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->wakeFd < 0) {
+            LOG_ERROR("Create eventfd error!");
+            isClose_ = true;
+            break;
+        }
+        if (ioUring_) {
+            // eventfd 和监听套接字的多发 poll/accept 在事件循环开始时提交
+            loop->uring.reset(new Uring(URING_ENTRIES, URING_BUF_COUNT, URING_BUF_SIZE));
+            if (!loop->uring->IsValid()) {
+                LOG_ERROR("Create io_uring error!");
+                isClose_ = true;
+                break;
+            }
+            loop->uringConns.resize(loop->users.MaxFd());
+        }
+        else {
+            loop->epoller.reset(new Epoller());
+            if (!loop->epoller->AddFd(loop->wakeFd, EPOLLIN)) {
+                LOG_ERROR("Add eventfd error!");
+                isClose_ = true;
+                break;
+            }
+        }
+        reactors_.emplace_back(std::move(loop));
+        if (!InitSocket_(reactors_.back().get())) { isClose_ = true; break; }
+    }
 }
 
 WebServer::~WebServer() {
-    close(listenFd_);
     isClose_ = true;
+    for (auto& t : loopThreads_) {
+        if (t.joinable()) t.join();
+    }
+    Metrics::Instance()->SetCollector(nullptr);
+    Tracer::Instance()->Close();
+    dbExecutor_.reset();        // 先等数据库线程把手上的任务做完，它们的回调还会用到线程池和事件循环
+    registerBatcher_.reset();   // 数据库线程可能还提交了注册，最后写完
+    for (auto& loop : reactors_) {
+        if (loop->listenFd >= 0) close(loop->listenFd);
+        if (loop->wakeFd >= 0) close(loop->wakeFd);
+    }
     free(srcDir_);
     SqlConnPool::Instance()->ClosePool();
 }
 
 void WebServer::Start() {
-    int timeMS = -1;    // epoll wait timeout == -1 无事件将阻塞
     if (!isClose_) { LOG_INFO(" ========== Server Start! ========== ");}
-    
+    if (reactorNum_ == 0) {
+        Loop_(reactors_[0].get());
+        return;
+    }
+    // one loop per thread：内核通过 SO_REUSEPORT 把新连接均匀分给各个监听套接字
+    for (auto& loop : reactors_) {
+        loopThreads_.emplace_back(loop->uring ? &WebServer::UringLoop_ : &WebServer::Loop_, this, loop.get());
+    }
+    for (auto& t : loopThreads_) {
+        t.join();
+    }
+}
+
+void WebServer::Loop_(Reactor* loop) {
+    int timeMS = -1;    // epoll wait timeout == -1 无事件将阻塞
+    loop->timer->BindThread();      // 定时器只由本线程操作，其他线程的请求经命令队列转过来
+    CoarseClock::Update();          // 本线程的定时器、日志、Date 头都用每轮缓存的时间
+
     while (!isClose_) {
         if (timeoutMS_ > 0) {
             // // 获取下一次的超时等待事件(至少这个时间才会有用户过期，每次关闭超时连接则需要有新的请求进来)
-            timeMS = timer_->GetNextTick();
+            // 其中会先执行工作线程提交的延期/取消命令
+            timeMS = loop->timer->GetNextTick();
         }
 
-        int eventCnt = epoller_->Wait(timeMS);
+        int eventCnt = loop->epoller->Wait(timeMS);
+        CoarseClock::Update();
+        if (Tracer::Enabled()) loop->wakeTick = Tracer::Now();
         for (int i = 0; i < eventCnt; i++) {
             // 处理事件
-            int fd = epoller_->GetEventFd(i);
-            uint32_t events = epoller_->GetEvents(i);
+            int fd = loop->epoller->GetEventFd(i);
+            uint32_t events = loop->epoller->GetEvents(i);
 
-            if (fd == listenFd_) {
-                DealListen_();
+            if (fd == loop->listenFd) {
+                DealListen_(loop);
+                continue;
             }
-            else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
+            if (fd == loop->wakeFd) {
+                DoPendingTasks_(loop);
+                continue;
+            }
+
+            // 同一批事件里fd可能已经被关闭并分给了新连接，代数对不上的是旧连接的事件
+            uint32_t gen = loop->epoller->GetEventTag(i);
+            if (!loop->users.IsCurrent(fd, gen)) {
+                continue;
+            }
+            HttpConn* client = loop->users.Get(fd);
+            assert(client);
+            if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                DealClose_(loop, client, gen);
             }
             else if (events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
+                DealRead_(loop, client, gen);
             }
             else if (events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
+                DealWrite_(loop, client, gen);
             }
             else {
                 LOG_ERROR("Unexpected event.");
@@ -81,15 +177,194 @@ void WebServer::Start() {
     }
 }
 
-// 处理写事件，主要逻辑是将OnWrite加入线程池的任务队列中
-void WebServer::DealWrite_(HttpConn *client) {
+// 和 Loop_ 的区别：
+// - 新连接由多发 accept 送来，每个连接挂一个多发 recv，数据在内核选的缓冲区里，拷进读缓冲区后马上还回去；
+// - 响应生成后直接提交 sendmsg，不需要先注册 EPOLLOUT，也不需要重新注册 EPOLLIN；
+// - 这一轮处理完成事件时提交的 SQE 都攒到下一次 Wait，和等待合并成一次 io_uring_enter。
+void WebServer::UringLoop_(Reactor* loop) {
+    int timeMS = -1;
+    loop->timer->BindThread();
+    CoarseClock::Update();
+    loop->uring->AcceptMultishot(loop->listenFd, UringData_(URING_ACCEPT, loop->listenFd, 0));
+    loop->uring->PollMultishot(loop->wakeFd, POLLIN, UringData_(URING_WAKE, loop->wakeFd, 0));
+
+    while (!isClose_) {
+        if (timeoutMS_ > 0) {
+            timeMS = loop->timer->GetNextTick();
+        }
+
+        int eventCnt = loop->uring->Wait(timeMS);
+        CoarseClock::Update();
+        if (Tracer::Enabled()) loop->wakeTick = Tracer::Now();
+        for (int i = 0; i < eventCnt; i++) {
+            uint64_t data = loop->uring->GetData(i);
+            int fd = static_cast<int>(data & 0xffffff);
+            UringOp op = static_cast<UringOp>((data >> 24) & 0xff);
+            uint32_t gen = static_cast<uint32_t>(data >> 32);
+            int res = loop->uring->GetResult(i);
+
+            if (op == URING_ACCEPT) {
+                if (res >= 0) {
+                    struct sockaddr_in addr;
+                    socklen_t len = sizeof(addr);
+                    getpeername(res, (struct sockaddr*)&addr, &len);
+                    if (HttpConn::userCount >= MAX_FD || res >= loop->users.MaxFd()) {
+                        SendError_(res, "Server busy!");
+                        LOG_WARN("Clients is full!");
+                    }
+                    else {
+                        AddClient_(loop, res, addr);
+                    }
+                }
+                else {
+                    LOG_WARN("Accept error: %d", -res);
+                }
+                if (!loop->uring->HasMore(i)) {
+                    loop->uring->AcceptMultishot(loop->listenFd, data);
+                }
+            }
+            else if (op == URING_WAKE) {
+                DoPendingTasks_(loop);
+                if (!loop->uring->HasMore(i)) {
+                    loop->uring->PollMultishot(loop->wakeFd, POLLIN, data);
+                }
+            }
+            else if (op == URING_RECV) {
+                OnUringRecv_(loop, i, fd, gen);
+            }
+            else if (op == URING_SEND) {
+                OnUringSend_(loop, i, fd, gen);
+            }
+            else {
+                LOG_ERROR("Unexpected completion.");
+            }
+        }
+    }
+}
+
+void WebServer::OnUringRecv_(Reactor* loop, size_t i, int fd, uint32_t gen) {
+    Uring* uring = loop->uring.get();
+    int res = uring->GetResult(i);
+    int bid = uring->HasBuffer(i) ? uring->GetBufferId(i) : -1;
+    UringConn& conn = loop->uringConns[fd];
+    HttpConn* client = loop->users.Get(fd);
+    if (!loop->users.IsCurrent(fd, gen) || !client) {
+        if (bid >= 0) uring->RecycleBuffer(bid);
+        return;
+    }
+    conn.recvArmed = uring->HasMore(i);
+    if (res > 0 && !conn.closing) {
+        client->AppendRead(uring->GetBuffer(bid), res);
+    }
+    if (bid >= 0) uring->RecycleBuffer(bid);
+
+    if (conn.closing) {
+        TryRelease_(loop, client);
+    }
+    else if (res > 0) {
+        ExtentTime_(loop, client, gen);
+        if (Tracer::Enabled()) client->TraceDispatch(Stamp_(loop), true);
+        if (!conn.recvArmed) ArmRecv_(loop, client);
+        // 响应还没发完或者在等数据库时先攒着，发完或者结果回来后再处理；
+        // 多发 recv 停不下来，等数据库时攒得太多就关闭连接
+        if (client->IsVerifying() && client->ReadBytes() > MAX_VERIFY_READ) {
+            LOG_WARN("Client[%d] sent too much while verifying!", fd);
+            CloseConn_(loop, client);
+        }
+        else if (!conn.sending && !client->IsVerifying()) OnProecess_(loop, client);
+    }
+    else if (res == -ENOBUFS) {
+        // 这一轮缓冲区被用完了，上面已经还回去，重新挂上
+        ArmRecv_(loop, client);
+    }
+    else {
+        CloseConn_(loop, client);   // 对端关闭或者出错
+    }
+}
+
+void WebServer::OnUringSend_(Reactor* loop, size_t i, int fd, uint32_t gen) {
+    int res = loop->uring->GetResult(i);
+    UringConn& conn = loop->uringConns[fd];
+    HttpConn* client = loop->users.Get(fd);
+    if (!loop->users.IsCurrent(fd, gen) || !client) return;
+    conn.sending = false;
+    if (conn.closing) {
+        TryRelease_(loop, client);
+        return;
+    }
+    if (res <= 0) {
+        CloseConn_(loop, client);
+        return;
+    }
+    ExtentTime_(loop, client, gen);
+    client->Sent(res);
+    if (client->ToWriteBytes() > 0) {
+        StartSend_(loop, client);       // 只发出了一部分
+    }
+    else if (client->IsKeepAlive()) {
+        OnProecess_(loop, client);      // 处理发送期间收到的请求
+    }
+    else {
+        CloseConn_(loop, client);
+    }
+}
+
+void WebServer::ArmRecv_(Reactor* loop, HttpConn* client) {
+    int fd = client->GetFd();
+    if (loop->uring->RecvMultishot(fd, UringData_(URING_RECV, fd, loop->users.Generation(fd)))) {
+        loop->uringConns[fd].recvArmed = true;
+    }
+    else {
+        LOG_ERROR("Client[%d] submit recv error!", fd);
+        CloseConn_(loop, client);
+    }
+}
+
+void WebServer::StartSend_(Reactor* loop, HttpConn* client) {
+    int fd = client->GetFd();
+    UringConn& conn = loop->uringConns[fd];
+    struct iovec* iov = nullptr;
+    int cnt = client->PendingIov(&iov);
+    memset(&conn.msg, 0, sizeof(conn.msg));
+    conn.msg.msg_iov = iov;
+    conn.msg.msg_iovlen = cnt;
+    if (cnt > 0 && loop->uring->SendMsg(fd, &conn.msg, UringData_(URING_SEND, fd, loop->users.Generation(fd)))) {
+        conn.sending = true;
+    }
+    else {
+        LOG_ERROR("Client[%d] submit send error!", fd);
+        CloseConn_(loop, client);
+    }
+}
+
+void WebServer::TryRelease_(Reactor* loop, HttpConn* client) {
+    UringConn& conn = loop->uringConns[client->GetFd()];
+    if (conn.closing && !conn.recvArmed && !conn.sending) {
+        conn.closing = false;
+        client->Close();
+    }
+}
+
+// 处理写事件，单Reactor模式下将OnWrite加入线程池的任务队列中，多Reactor模式下直接在本线程处理
+void WebServer::DealWrite_(Reactor* loop, HttpConn *client, uint32_t gen) {
     assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    ExtentTime_(loop, client, gen);
+    TraceStamp stamp = Stamp_(loop);
+    if (threadpool_) {
+        // 以fd为key：亲和模式下同一连接的任务总在同一个工作线程上按顺序执行
+        threadpool_->AddTask(client->GetFd(), [this, loop, client, gen, stamp] {
+            if (loop->users.IsCurrent(client->GetFd(), gen)) OnWrite_(loop, client, stamp);
+        });
+    }
+    else {
+        OnWrite_(loop, client, stamp);
+    }
 }
 
-void WebServer::OnWrite_(HttpConn *client) {
+void WebServer::OnWrite_(Reactor* loop, HttpConn *client, const TraceStamp& stamp) {
     assert(client);
+    if (client->IsClose()) return;      // 亲和模式下关闭之前已经排队的事件
+    if (Tracer::Enabled()) client->TraceDispatch(stamp, false);
     int ret = -1;
     int writeErrno = 0;
     ret = client->write(&writeErrno);   // 将写缓冲区的数据写入客户端套接字
@@ -97,96 +372,312 @@ void WebServer::OnWrite_(HttpConn *client) {
     if (client->ToWriteBytes() == 0) {
         // 如果待发送数据字节数为 0，表示传输完成
         if (client->IsKeepAlive()) {
-            // 如果需要保持连接，则修改文件描述符监测事件为读事件
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN); // 换成监测读事件
+            // 如果需要保持连接，先处理读缓冲区里已经到达的流水线请求，没有的话再换成监测读事件
+            OnProecess_(loop, client);
             return;
         }
     }
     else if (ret  < 0) {
         // 如果写操作返回值小于 0，表示发生错误
         if (writeErrno == EAGAIN) {     // 缓冲区满了
+            Metrics::Add(M_EAGAIN_REARMS);
             // 修改文件描述符监测事件为写事件，继续传输
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            ModConnEvent_(loop, client, connEvent_ | EPOLLOUT);
             return;
         }
     }
-    CloseConn_(client);
+    CloseConn_(loop, client);
 }
 
-// 处理读事件，主要逻辑是将OnRead加入线程池的任务队列中
-void WebServer::DealRead_(HttpConn *client) {
+// 处理读事件，单Reactor模式下将OnRead加入线程池的任务队列中，多Reactor模式下直接在本线程处理
+void WebServer::DealRead_(Reactor* loop, HttpConn *client, uint32_t gen) {
     assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client)); // 右值，bind将参数和函数绑定
+    ExtentTime_(loop, client, gen);
+    TraceStamp stamp = Stamp_(loop);
+    if (threadpool_) {
+        // 只捕获三个指针、代数和追踪时间（48字节），任务不需要堆分配；执行时fd已经换了连接就丢弃
+        threadpool_->AddTask(client->GetFd(), [this, loop, client, gen, stamp] {
+            if (loop->users.IsCurrent(client->GetFd(), gen)) OnRead_(loop, client, stamp);
+        });
+    }
+    else {
+        OnRead_(loop, client, stamp);
+    }
 }
 
-void WebServer::ExtentTime_(HttpConn *client) {
+void WebServer::ExtentTime_(Reactor* loop, HttpConn *client, uint32_t gen) {
     assert(client);
     if (timeoutMS_ > 0) {
-        timer_->Adjust(client->GetFd(), timeoutMS_);
+        loop->timer->Adjust(client->GetFd(), gen, timeoutMS_);
+    }
+}
+
+TraceStamp WebServer::Stamp_(Reactor* loop) {
+    TraceStamp stamp;
+    if (Tracer::Enabled()) {
+        stamp.wake = loop->wakeTick;
+        if (threadpool_) stamp.enqueue = Tracer::Now();
     }
+    return stamp;
 }
 
-void WebServer::OnRead_(HttpConn *client) {
+void WebServer::OnRead_(Reactor* loop, HttpConn *client, const TraceStamp& stamp) {
     assert(client);
+    if (client->IsClose()) return;
+    if (Tracer::Enabled()) client->TraceDispatch(stamp, true);
     int ret = -1;
     int readErrno = 0;
     ret = client->read(&readErrno);     // 读取客户端套接字的数据，读到httpconn的读缓存区
     if (ret <= 0 && readErrno != EAGAIN) {  // 读异常就关闭客户端
-        CloseConn_(client);
+        CloseConn_(loop, client);
         return ;
     }
     // 业务逻辑的处理（先读后处理）
-    OnProecess_(client);
+    OnProecess_(loop, client);
 }
 
 /* 处理读（请求）数据的函数 */
-void WebServer::OnProecess_(HttpConn *client) {
+void WebServer::OnProecess_(Reactor* loop, HttpConn *client) {
     assert(client);
     // 首先调用process() 进行逻辑处理
-    if (client->process()) {        // 根据返回的信息重新将fd置为EPOLLOUT（写）或EPOLLIN（读）
-        // 读完事件就跟内核说可以写了
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);    // 响应成功，修改监听事件为写,等待OnWrite_()发送
+    while (true) {
+        if (!client->process()) {
+            if (!client->IsVerifying()) {
+                if (!loop->uring) {     // io_uring 的多发 recv 一直挂着，不需要重新注册
+                    // 写完事件就跟内核说可以读了
+                    ModConnEvent_(loop, client, connEvent_ | EPOLLIN);
+                }
+                return;
+            }
+            // 登录/注册请求在等数据库，先不监听这个连接，结果回来后再接着处理；
+            // 登录缓存命中时结果已经有了，在这里接着生成响应，不递归调用
+            if (SubmitVerify_(loop, client)) continue;
+            if (!loop->uring && !(connEvent_ & EPOLLONESHOT)) {
+                // 没有EPOLLONESHOT时读事件一直有效，process() 又不消费输入，客户端一直发读缓冲区就一直涨；
+                // 去掉读事件，结果回来后 OnProecess_() 重新注册 EPOLLIN，期间到达的数据那时再读
+                ModConnEvent_(loop, client, connEvent_);
+            }
+            return;
+        }
+        if (loop->uring) {
+            StartSend_(loop, client);   // io_uring 直接提交发送
+            return;
+        }
+        // 响应先直接写：套接字缓冲区放得下（小响应基本都是）就不需要注册EPOLLOUT再等一轮epoll_wait
+        int writeErrno = 0;
+        ssize_t ret = client->write(&writeErrno);
+        if (client->ToWriteBytes() > 0) {
+            if (ret < 0 && writeErrno != EAGAIN) {
+                CloseConn_(loop, client);
+                return;
+            }
+            // 没写完，剩下的等可写了由OnWrite_()发送
+            if (ret < 0) Metrics::Add(M_EAGAIN_REARMS);
+            ModConnEvent_(loop, client, connEvent_ | EPOLLOUT);
+            return;
+        }
+        if (!client->IsKeepAlive()) {
+            CloseConn_(loop, client);
+            return;
+        }
+        // 写完了，接着处理读缓冲区里已经到达的流水线请求
     }
-    else {
-        // 写完事件就跟内核说可以读了
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+}
+
+// 数据库查询在 DbExecutor 的线程上执行，不占用工作线程和事件循环；
+// 结果投递回连接原来的处理线程：单Reactor模式交给线程池（亲和模式下是连接所属的工作线程），多Reactor模式交给所属的事件循环
+// 返回 true 表示登录缓存命中，结果已经设置好，由调用者接着处理
+bool WebServer::SubmitVerify_(Reactor* loop, HttpConn* client) {
+    std::string name, pwd;
+    bool isLogin = false;
+    if (!client->TakeVerify(&name, &pwd, &isLogin)) return false;   // 已经提交过了
+    if (isLogin && CredentialCache::Instance()->Match(name, pwd)) {
+        // 最近验证过的用户直接在内存里比对，不经过数据库线程
+        client->SetVerifyResult(true);
+        return true;
     }
+    int fd = client->GetFd();
+    uint32_t gen = loop->users.Generation(fd);
+    int64_t submitNs = Metrics::NowNs();
+    uint32_t traceId = client->TraceId();
+    uint64_t submitTick = traceId ? Tracer::Now() : 0;
+    auto done = [this, loop, client, fd, gen, submitNs, traceId, submitTick](bool ok) {
+        if (traceId) Tracer::Record(T_DB, traceId, submitTick, Tracer::Now());
+        int64_t waitNs = Metrics::NowNs() - submitNs;
+        Metrics::Record(H_DB_WAIT, waitNs);
+        Metrics::Add(M_DB_REQUESTS);
+        Metrics::Add(M_DB_WAIT_US, waitNs / 1000);
+        if (threadpool_) {
+            threadpool_->AddTask(fd, [this, loop, client, gen, ok] { OnVerified_(loop, client, gen, ok); });
+        }
+        else {
+            RunInLoop_(loop, [this, loop, client, gen, ok] { OnVerified_(loop, client, gen, ok); });
+        }
+    };
+    dbExecutor_->Submit([this, done, name, pwd, isLogin, traceId, submitTick](MYSQL* sql) {
+        if (traceId) Tracer::Record(T_DB_QUEUE, traceId, submitTick, Tracer::Now());
+        if (isLogin) {
+            done(HttpRequest::UserVerify(sql, name, pwd, true));
+        }
+        else if (HttpRequest::UserAvailable(sql, name, pwd)) {
+            // 注册：查重在数据库线程上做完，插入交给批量写线程，写入提交后再回调
+            registerBatcher_->Submit(name, pwd, done);
+        }
+        else {
+            done(false);
+        }
+    });
+    return false;
+}
+
+void WebServer::OnVerified_(Reactor* loop, HttpConn* client, uint32_t gen, bool ok) {
+    // 等数据库的时候连接可能已经超时关闭，fd甚至已经给了新连接
+    if (!loop->users.IsCurrent(client->GetFd(), gen) || client->IsClose()) return;
+    if (loop->uring && loop->uringConns[client->GetFd()].closing) return;
+    client->SetVerifyResult(ok);
+    ExtentTime_(loop, client, gen);
+    OnProecess_(loop, client);
+}
+
+// 连接数、连接池、数据库线程队列等瞬时状态，在请求 /__metrics 的线程上执行
+void WebServer::CollectMetrics_(std::string& out) {
+    Metrics::AppendMetric(out, "webserver_connections", "gauge", "Open client connections.", HttpConn::userCount);
+    SqlConnPool::Stats pool = SqlConnPool::Instance()->GetStats();
+    Metrics::AppendMetric(out, "webserver_sql_pool_connections", "gauge", "SQL connections in the pool.", pool.total);
+    Metrics::AppendMetric(out, "webserver_sql_pool_idle", "gauge", "Idle SQL connections.", pool.idle);
+    Metrics::AppendMetric(out, "webserver_sql_pool_in_use", "gauge", "SQL connections in use.", pool.inUse);
+    Metrics::AppendMetric(out, "webserver_sql_pool_max", "gauge", "Upper bound of the SQL pool.", pool.maxConn);
+    Metrics::AppendMetric(out, "webserver_sql_pool_acquired_total", "counter", "SQL connections handed out.", pool.acquired);
+    Metrics::AppendMetric(out, "webserver_sql_pool_timeouts_total", "counter", "SQL acquires that timed out.", pool.timeouts);
+    Metrics::AppendMetric(out, "webserver_sql_pool_created_total", "counter", "SQL connections opened.", pool.created);
+    Metrics::AppendMetric(out, "webserver_sql_pool_broken_total", "counter", "SQL connections dropped as broken.", pool.broken);
+    Metrics::AppendMetric(out, "webserver_db_queue_pending", "gauge", "Tasks waiting for a database thread.", dbExecutor_->Pending());
+    Metrics::AppendMetric(out, "webserver_register_pending", "gauge", "Registrations waiting for the batch writer.", registerBatcher_->Pending());
+    Metrics::AppendMetric(out, "webserver_register_batches_total", "counter", "Registration INSERT statements executed.", registerBatcher_->Batches());
+    Metrics::AppendMetric(out, "webserver_register_rows_total", "counter", "Users registered.", registerBatcher_->Rows());
+    Metrics::AppendMetric(out, "webserver_log_dropped_total", "counter", "Log lines dropped because the queue was full.", Log::Instance()->Dropped());
+}
+
+void WebServer::RunInLoop_(Reactor* loop, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> locker(loop->taskMtx);
+        loop->tasks.emplace_back(std::move(task));
+    }
+    uint64_t one = 1;
+    ssize_t n = ::write(loop->wakeFd, &one, sizeof(one));
+    (void)n;    // 计数器溢出（EAGAIN）时eventfd本来就是可读的
+}
+
+void WebServer::DoPendingTasks_(Reactor* loop) {
+    uint64_t cnt = 0;
+    ssize_t n = ::read(loop->wakeFd, &cnt, sizeof(cnt));
+    (void)n;
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> locker(loop->taskMtx);
+        tasks.swap(loop->tasks);
+    }
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+void WebServer::ModConnEvent_(Reactor* loop, HttpConn *client, uint32_t events) {
+    int fd = client->GetFd();
+    // 没有EPOLLONESHOT时注册的事件一直有效，和当前的一样就不再调用epoll_ctl（多Reactor模式下写完一次就能读，基本不用重新注册）
+    if (!(events & EPOLLONESHOT) && loop->users.Armed(fd) == events) return;
+    Metrics::Add(M_EPOLL_MODS);
+    loop->users.SetArmed(fd, events);
+    loop->epoller->ModFd(fd, events, loop->users.Generation(fd));
 }
 
 // 处理监听套接字，主要逻辑是accept新的套接字，并加入timer和epoller中
-void WebServer::DealListen_() {
+void WebServer::DealListen_(Reactor* loop) {
     struct sockaddr_in addr;
     socklen_t len = sizeof(addr);
 
     do {
-        int fd = accept(listenFd_, (struct sockaddr*)&addr, &len);
+        int fd = accept(loop->listenFd, (struct sockaddr*)&addr, &len);
         if (fd <= 0) return;
-        else if (HttpConn::userCount >= MAX_FD) {
+        else if (HttpConn::userCount >= MAX_FD || fd >= loop->users.MaxFd()) {
             SendError_(fd, "Server busy!");
             LOG_WARN("Clients is full!");
             return;
         }
-        AddClient_(fd, addr);
-    } while (listenEvent_ & EPOLLIN);
+        AddClient_(loop, fd, addr);
+    } while (listenEvent_ & EPOLLET);
 }
 
-void WebServer::AddClient_(int fd, sockaddr_in addr) {
+void WebServer::AddClient_(Reactor* loop, int fd, sockaddr_in addr) {
     assert(fd > 0);
-    users_[fd].init(fd, addr);
+    Metrics::Add(M_ACCEPTS);
+    uint32_t gen = 0;
+    HttpConn* client = loop->users.Acquire(fd, &gen);
+    assert(client);
     if (timeoutMS_ > 0) {
-        // 创建一个绑定了当前对象的成员函数 CloseConn_ 的函数对象
-        timer_->Add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));  
+        // 超时回调：计数后关闭连接
+        loop->timer->Add(fd, timeoutMS_, [this, loop, client, gen] {
+            Metrics::Add(M_TIMER_EXPIRED);
+            DealClose_(loop, client, gen);
+        }, gen);
+    }
+    if (loop->uring) {
+        // 套接字保持阻塞模式：没有数据时 recv/sendmsg 由 io_uring 挂起等待，不会以 EAGAIN 结束
+        loop->uringConns[fd] = UringConn();
+        client->init(fd, addr);
+        ArmRecv_(loop, client);
+        LOG_INFO("Client[%d] in!", fd);
+        return;
     }
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
     SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    if (affinity_) {
+        // 复用的fd可能还有旧连接的任务在工作线程里排队，初始化也交给同一个线程，排在它们后面
+        threadpool_->AddTask(fd, [this, loop, client, fd, addr, gen] {
+            client->init(fd, addr);
+            loop->users.SetArmed(fd, EPOLLIN | connEvent_);
+            loop->epoller->AddFd(fd, EPOLLIN | connEvent_, gen);
+        });
+    }
+    else {
+        client->init(fd, addr);
+        loop->users.SetArmed(fd, EPOLLIN | connEvent_);
+        loop->epoller->AddFd(fd, EPOLLIN | connEvent_, gen);
+    }
+    LOG_INFO("Client[%d] in!", fd);
+}
+
+// 亲和模式下关闭也交给连接所属的工作线程，这样连接的状态只会被这一个线程修改
+void WebServer::DealClose_(Reactor* loop, HttpConn *client, uint32_t gen) {
+    assert(client);
+    if (affinity_) {
+        threadpool_->AddTask(client->GetFd(), [this, loop, client, gen] {
+            if (loop->users.IsCurrent(client->GetFd(), gen)) CloseConn_(loop, client);
+        });
+    }
+    else if (loop->users.IsCurrent(client->GetFd(), gen)) {
+        CloseConn_(loop, client);
+    }
 }
 
-void WebServer::CloseConn_(HttpConn *client) {
+void WebServer::CloseConn_(Reactor* loop, HttpConn *client) {
     assert(client);
+    if (client->IsClose()) return;
+    if (loop->uring && loop->uringConns[client->GetFd()].closing) return;
     LOG_INFO("Client[%d] quit!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
+    if (timeoutMS_ > 0) {
+        // 连接要关闭了，超时回调不再需要；在工作线程里调用时由事件循环线程稍后执行取消
+        int fd = client->GetFd();
+        loop->timer->Cancel(fd, loop->users.Generation(fd));
+    }
+    if (loop->uring) {
+        UringConn& conn = loop->uringConns[client->GetFd()];
+        conn.closing = true;
+        // 让挂着的 recv 以 0 结束、阻塞中的 sendmsg 出错返回，最后一个完成事件回来时再关闭
+        shutdown(client->GetFd(), SHUT_RDWR);
+        TryRelease_(loop, client);
+        return;
+    }
+    loop->epoller->DelFd(client->GetFd());
     client->Close();
 }
 
@@ -222,10 +713,15 @@ void WebServer::InitEventMode_(int trigMode) {
             connEvent_ |= EPOLLET;
             break;
     }
+    // 多Reactor模式下连接只会被所属的事件循环线程处理，不需要EPOLLONESHOT；
+    // 亲和模式下同一连接的事件在同一个工作线程上串行处理，ET模式下也不需要（LT模式去掉的话数据没读走前每次epoll_wait都会重复投递）
+    if (reactorNum_ > 0 || (affinity_ > 0 && (connEvent_ & EPOLLET))) {
+        connEvent_ &= ~EPOLLONESHOT;
+    }
     HttpConn::isET = (connEvent_ & EPOLLET);    // 标记HTTP连接是否采用边缘触发模式
 }
 
-bool WebServer::InitSocket_() {
+bool WebServer::InitSocket_(Reactor* loop) {
     int ret;
     struct sockaddr_in addr;
     addr.sin_family = AF_INET;
@@ -234,8 +730,8 @@ bool WebServer::InitSocket_() {
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
     addr.sin_port = htons(port_);
 
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (listenFd_ < 0) {
+    loop->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (loop->listenFd < 0) {
         LOG_ERROR("Create socket error!", port_);
         return false;
     }
@@ -243,35 +739,50 @@ bool WebServer::InitSocket_() {
     int optval = 1;
     // 端口复用
     // 设置套接字选项，允许地址重用，确保端口可以立即重用
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
+    ret = setsockopt(loop->listenFd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
     if (ret == -1) {
         LOG_ERROR("set socket setsockopt error!");
-        close(listenFd_);
+        close(loop->listenFd);
         return false;
     }
 
+    // 多Reactor模式下每个事件循环各自创建监听套接字并绑定同一端口，由内核在它们之间分配新连接
+    if (reactorNum_ > 0) {
+        ret = setsockopt(loop->listenFd, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(int));
+        if (ret == -1) {
+            LOG_ERROR("set socket SO_REUSEPORT error!");
+            close(loop->listenFd);
+            return false;
+        }
+    }
+
     // 将套接字绑定到指定地址和端口
-    ret = bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr));
+    ret = bind(loop->listenFd, (struct sockaddr*)&addr, sizeof(addr));
     if (ret < 0) {
         LOG_ERROR("Bind Port:%d error!", port_);
-        close(listenFd_);
+        close(loop->listenFd);
         return false;
     }
 
     // 开始监听连接请求，最多允许8个连接同时排队等待处理
-    ret = listen(listenFd_, 8);
+    ret = listen(loop->listenFd, 8);
     if (ret < 0) {
         LOG_ERROR("Listen port:%d error!", port_);
-        close(listenFd_);
+        close(loop->listenFd);
         return false;
     }
-    ret = epoller_->AddFd(listenFd_, EPOLLIN | listenEvent_);   // 将监听socket加入epoller
+    if (loop->uring) {
+        // io_uring 用多发 accept 接受连接，监听套接字保持阻塞模式
+        LOG_INFO("Server port:%d", port_);
+        return true;
+    }
+    ret = loop->epoller->AddFd(loop->listenFd, EPOLLIN | listenEvent_);   // 将监听socket加入epoller
     if (ret == 0) {
         LOG_ERROR("Add listen error!");
-        close(listenFd_);
+        close(loop->listenFd);
         return false;
     }
-    SetFdNonblock(listenFd_);   // 设置非阻塞
+    SetFdNonblock(loop->listenFd);   // 设置非阻塞
     LOG_INFO("Server port:%d", port_);
     return true;
 }
@@ -8,57 +8,128 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "Epoller.h"
-#include "../timer/HeepTimer.h"
+#include "Uring.h"
+#include "ConnTable.h"
+#include "../timer/LoopTimer.h"
+#include "../timer/CoarseClock.h"
 #include "../log/Log.h"
+#include "../log/Metrics.h"
+#include "../log/Trace.h"
 #include "../pool/SqlConnPool.h"
 #include "../pool/ThreadPool.h"
+#include "../pool/DbExecutor.h"
 #include "../http/HttpConn.h"
+#include "../http/CredentialCache.h"
+#include "../http/RegisterBatcher.h"
 
 class WebServer {
 public:
     WebServer(int port, int trigMode, int timeoutMS,
             int sqlPort, const char* sqlUser, const char* sqlPwd, const char* dbName,
-            int connPoolNum, int threadNum, bool openLog, int logLevel, int logQueSize);
+            int connPoolNum, int threadNum, bool openLog, int logLevel, int logQueSize,
+            int reactorNum = 0, bool zeroCopy = false, int affinity = 0,
+            bool deferredLog = false, int traceSample = 0, bool ioUring = false);
     ~WebServer();
     void Start();
 
 private:
-    bool InitSocket_();                         // 初始化套接字
+    // io_uring 后端里一个连接还在内核里的操作。close(fd) 不会取消 io_uring 里引用着这个套接字的操作，
+    // 所以关闭时先 shutdown 让它们结束，都结束了才真正关闭连接
+    struct UringConn {
+        bool recvArmed = false;     // 多发 recv 还在
+        bool sending = false;
+        bool closing = false;
+        struct msghdr msg;          // sendmsg 从提交到完成都要保持有效
+    };
+
+    // 一个事件循环独占的资源：监听套接字、epoll、定时器以及由它负责的那部分连接
+    // 单Reactor模式下只有一个，由主线程运行，读写交给线程池；
+    // 多Reactor模式下每个线程一个（one loop per thread），各自用SO_REUSEPORT监听同一端口，读写在本线程内完成
+    struct Reactor {
+        int listenFd = -1;
+        std::unique_ptr<Epoller> epoller;
+        std::unique_ptr<LoopTimer> timer;           // 其他线程也可以请求延期和取消
+        ConnTable users;                            // 用户连接，以fd为下标
+        int wakeFd = -1;                            // eventfd，其他线程投递任务后用它唤醒epoll_wait
+        std::mutex taskMtx;
+        std::vector<std::function<void()>> tasks;   // 其他线程投递到本事件循环执行的任务（数据库验证的结果）
+        uint64_t wakeTick = 0;                      // 这一轮 epoll_wait 返回的时间，只在追踪时更新
+        std::unique_ptr<Uring> uring;               // io_uring 后端，有它时不创建 epoller
+        std::vector<UringConn> uringConns;          // 以fd为下标
+    };
+
+    bool InitSocket_(Reactor* loop);            // 初始化套接字
     void InitEventMode_(int trigMode);          // 初始化事件模式
-    void AddClient_(int fd, sockaddr_in addr);  // 添加客户端连接
+    void AddClient_(Reactor* loop, int fd, sockaddr_in addr);  // 添加客户端连接
+    void Loop_(Reactor* loop);                  // 事件循环
+    void UringLoop_(Reactor* loop);             // io_uring 后端的事件循环
+
+    void DealListen_(Reactor* loop);                        // 处理监听事件
+    void DealWrite_(Reactor* loop, HttpConn* client, uint32_t gen);     // 处理写事件
+    void DealRead_(Reactor* loop, HttpConn* client, uint32_t gen);      // 处理读事件
+    void DealClose_(Reactor* loop, HttpConn* client, uint32_t gen);     // 处理关闭事件（挂断、超时）
+
+    void SendError_(int fd, const char* info);              // 发送错误信息
+    void ExtentTime_(Reactor* loop, HttpConn* client, uint32_t gen);   // 延长连接时间
+    void CloseConn_(Reactor* loop, HttpConn* client);       // 关闭连接
+    void ModConnEvent_(Reactor* loop, HttpConn* client, uint32_t events);  // 修改连接监听的事件，带上当前代数
+    TraceStamp Stamp_(Reactor* loop);                       // 投递读写事件时记下的时间，追踪关闭时为空
 
-    void DealListen_();                         // 处理监听事件
-    void DealWrite_(HttpConn* client);          // 处理写事件
-    void DealRead_(HttpConn* client);           // 处理读事件
+    void OnRead_(Reactor* loop, HttpConn* client, const TraceStamp& stamp);     // 读事件处理函数
+    void OnWrite_(Reactor* loop, HttpConn* client, const TraceStamp& stamp);    // 写事件处理函数
+    void OnProecess_(Reactor* loop, HttpConn* client); 
 
-    void SendError_(int fd, const char* info);  // 发送错误信息
-    void ExtentTime_(HttpConn* client);         // 延长连接时间
-    void CloseConn_(HttpConn* client);          // 关闭连接
+    bool SubmitVerify_(Reactor* loop, HttpConn* client);    // 把挂起的登录/注册请求交给数据库线程，登录缓存命中时直接返回 true
+    void OnVerified_(Reactor* loop, HttpConn* client, uint32_t gen, bool ok);   // 验证结果回到连接所属的线程
+    void RunInLoop_(Reactor* loop, std::function<void()> task);    // 任意线程调用，任务在事件循环线程执行
+    void CollectMetrics_(std::string& out);                 // /__metrics 导出时追加连接数、连接池等瞬时状态
+    void DoPendingTasks_(Reactor* loop);
 
-    void OnRead_(HttpConn* client);             // 读事件处理函数
-    void OnWrite_(HttpConn* client);            // 写事件处理函数
-    void OnProecess_(HttpConn* client); 
+    // io_uring 后端：完成事件的 user_data 是 代数 << 32 | 操作 << 24 | fd
+    enum UringOp { URING_ACCEPT = 1, URING_WAKE, URING_RECV, URING_SEND };
+    static uint64_t UringData_(UringOp op, int fd, uint32_t gen) {
+        return (static_cast<uint64_t>(gen) << 32) | (static_cast<uint64_t>(op) << 24) | static_cast<uint32_t>(fd);
+    }
+    void OnUringRecv_(Reactor* loop, size_t i, int fd, uint32_t gen);
+    void OnUringSend_(Reactor* loop, size_t i, int fd, uint32_t gen);
+    void ArmRecv_(Reactor* loop, HttpConn* client);         // 挂上多发 recv
+    void StartSend_(Reactor* loop, HttpConn* client);       // 把待发送的内存段交给 sendmsg
+    void TryRelease_(Reactor* loop, HttpConn* client);      // 关闭中的连接没有在途操作后才真正关闭
 
     static const int MAX_FD = 65536;
+    static const unsigned URING_ENTRIES = 1024;         // SQ 大小，CQ 是它的 4 倍
+    static const unsigned URING_BUF_COUNT = 1024;       // 每个事件循环的接收缓冲区个数（2 的幂）和大小
+    static const unsigned URING_BUF_SIZE = 2048;
+    static const size_t MAX_VERIFY_READ = 1 << 20;      // io_uring 下等数据库时读缓冲区最多攒的字节数，超过就关闭连接
 
     static int SetFdNonblock(int fd);           // 设置非阻塞套接字
 
     int port_;
     bool openLinger_;       // 是否开启连接延迟关闭
     int timeoutMS_;
-    bool isClose_;
-    int listenFd_;          // 监听套接字描述符
+    std::atomic<bool> isClose_;
+    int reactorNum_;        // 0：单Reactor + 线程池；>0：Reactor线程数
+    bool ioUring_;          // 用 io_uring 代替 epoll（仅多Reactor模式）
+    int affinity_;          // 0：任务交给任意工作线程；1：按fd固定工作线程；2：固定工作线程并绑定CPU
     char* srcDir_;
 
     uint32_t listenEvent_;      // 监听事件
     uint32_t connEvent_;        // 连接事件
 
-    std::unique_ptr<HeapTimer> timer_;
-    std::unique_ptr<ThreadPool> threadpool_;
-    std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HttpConn> users_;   // 用户连接映射
+    std::unique_ptr<ThreadPool> threadpool_;        // 仅单Reactor模式使用
+    std::unique_ptr<DbExecutor> dbExecutor_;        // 登录/注册的数据库查询
+    std::unique_ptr<RegisterBatcher> registerBatcher_;  // 注册的批量写入
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+    std::vector<std::thread> loopThreads_;
 };
 
 
@@ -0,0 +1,97 @@
+#ifndef COARSE_CLOCK_H
+#define COARSE_CLOCK_H
+
+/*
+ * 缓存的粗粒度时钟，定时器、日志和 HTTP 的 Date 头共用
+ * - 事件循环每次 epoll_wait 返回后调用一次 Update()，本线程之后读到的都是这次缓存的时间，
+ *   一轮事件里的所有定时器操作、日志都不再读时钟；
+ *   没有调用过 Update() 的线程（线程池的工作线程、基准测试）每次现读 *_COARSE 时钟，走 vDSO 只要几纳秒。
+ * - 日志的 "YYYY/MM/DD HH:MM:SS" 和 HTTP 的 Date 头按线程缓存，秒数变了才重新格式化，
+ *   每秒最多一次 localtime_r / gmtime_r。
+ * 状态都是 thread_local 的普通数据，不需要同步，也没有 TLS 初始化的开销。
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+class CoarseClock {
+public:
+    static const size_t LOG_TIME_LEN = 19;          // "YYYY/MM/DD HH:MM:SS"
+    static const size_t HTTP_DATE_LEN = 37;         // "Date: Sun, 18 Oct 2026 05:55:27 GMT\r\n"
+
+    // 事件循环每轮调用一次，刷新本线程缓存的时间
+    static void Update() {
+        State& s = Local_();
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        s.monoMs = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+        clock_gettime(CLOCK_REALTIME_COARSE, &s.real);
+        s.cached = true;
+    }
+
+    // 单调时间（毫秒），定时器用
+    static int64_t NowMs() {
+        State& s = Local_();
+        if (s.cached) return s.monoMs;
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    // 墙上时间，日志和 Date 头用
+    static struct timespec RealNow() {
+        State& s = Local_();
+        if (s.cached) return s.real;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return ts;
+    }
+
+    // sec 对应的本地时间 "YYYY/MM/DD HH:MM:SS"（不以 '\0' 结尾，长度 LOG_TIME_LEN）
+    static const char* LogTime(time_t sec) {
+        State& s = Local_();
+        if (s.logSec != sec) {
+            struct tm t;
+            localtime_r(&sec, &t);
+            char tmp[64];
+            snprintf(tmp, sizeof(tmp), "%04d/%02d/%02d %02d:%02d:%02d",
+                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+            memcpy(s.logTime, tmp, LOG_TIME_LEN);
+            s.logSec = sec;
+        }
+        return s.logTime;
+    }
+
+    // 当前时间的 "Date: ... GMT\r\n" 头（不以 '\0' 结尾，长度 HTTP_DATE_LEN）
+    static const char* HttpDate() {
+        State& s = Local_();
+        time_t sec = RealNow().tv_sec;
+        if (s.httpSec != sec) {
+            struct tm t;
+            gmtime_r(&sec, &t);
+            strftime(s.httpDate, sizeof(s.httpDate), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &t);
+            s.httpSec = sec;
+        }
+        return s.httpDate;
+    }
+
+private:
+    struct State {
+        bool cached;
+        int64_t monoMs;
+        struct timespec real;
+        time_t logSec;
+        char logTime[LOG_TIME_LEN];
+        time_t httpSec;
+        char httpDate[HTTP_DATE_LEN + 1];
+    };
+
+    static State& Local_() {
+        static thread_local State state;        // 零初始化
+        return state;
+    }
+};
+
+#endif // COARSE_CLOCK_H
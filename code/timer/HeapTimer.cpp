@@ -10,12 +10,12 @@ void HeapTimer::SwapNode_(size_t i, size_t j) {
 
 void HeapTimer::SiftUp_(size_t i) {
     assert(i >= 0 && i < heap_.size());
-    size_t parent = (i - 1) / 2;    // 父结点
-    while (parent >= 0) {
+    // size_t 永远 >= 0，i 为 0 时 (i - 1) / 2 会越界，所以用 i > 0 判断是否还有父结点
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;    // 父结点
         if (heap_[parent] > heap_[i]) {
             SwapNode_(parent, i);
             i = parent;
-            parent = (i - 1) / 2;
         }
         else 
             break;
@@ -0,0 +1,78 @@
+#include "LoopTimer.h"
+
+LoopTimer::LoopTimer(size_t queueCapacity) : owner_(std::this_thread::get_id()),
+        commands_(queueCapacity), hasOverflow_(false) {}
+
+void LoopTimer::BindThread() {
+    owner_.store(std::this_thread::get_id(), std::memory_order_release);
+}
+
+bool LoopTimer::InLoopThread() const {
+    return owner_.load(std::memory_order_acquire) == std::this_thread::get_id();
+}
+
+void LoopTimer::Add(int id, int timeout, const TimeoutCallback& cb, uint32_t tag) {
+    assert(InLoopThread());
+    wheel_.Add(id, timeout, cb, tag);
+}
+
+int LoopTimer::GetNextTick() {
+    assert(InLoopThread());
+    Drain_();
+    return wheel_.GetNextTick();
+}
+
+void LoopTimer::Adjust(int id, uint32_t tag, int timeout) {
+    Command cmd = {Command::ADJUST, id, tag, timeout};
+    if (InLoopThread()) {
+        Apply_(cmd);
+    }
+    else {
+        Push_(cmd);
+    }
+}
+
+void LoopTimer::Cancel(int id, uint32_t tag) {
+    Command cmd = {Command::CANCEL, id, tag, 0};
+    if (InLoopThread()) {
+        Apply_(cmd);
+    }
+    else {
+        Push_(cmd);
+    }
+}
+
+void LoopTimer::Push_(Command cmd) {
+    if (commands_.TryPush(std::move(cmd))) return;
+    std::lock_guard<std::mutex> locker(overflowMtx_);
+    overflow_.push_back(cmd);
+    hasOverflow_.store(true, std::memory_order_release);
+}
+
+void LoopTimer::Apply_(const Command& cmd) {
+    if (!wheel_.Contains(cmd.id, cmd.tag)) return;     // 定时器已经触发、取消，或者 fd 已经换了连接
+    if (cmd.type == Command::ADJUST) {
+        wheel_.Adjust(cmd.id, cmd.timeout);
+    }
+    else {
+        wheel_.Cancel(cmd.id);
+    }
+}
+
+void LoopTimer::Drain_() {
+    Command cmd;
+    while (commands_.TryPop(cmd)) {
+        Apply_(cmd);
+    }
+    if (hasOverflow_.load(std::memory_order_acquire)) {
+        std::vector<Command> cmds;
+        {
+            std::lock_guard<std::mutex> locker(overflowMtx_);
+            cmds.swap(overflow_);
+            hasOverflow_.store(false, std::memory_order_relaxed);
+        }
+        for (const Command& c : cmds) {
+            Apply_(c);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef LOOP_TIMER_H
+#define LOOP_TIMER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TimingWheel.h"
+#include "../pool/MpmcQueue.h"
+
+/*
+ * 事件循环的定时器，可以从任意线程请求延期和取消
+ * - 时间轮本身只由事件循环线程操作；
+ * - 其他线程（线程池的工作线程）的请求放进一个无锁命令队列，事件循环每次计算心搏间隔前先把命令执行完；
+ *   队列满了放进加锁的溢出队列，不会丢失命令；
+ * - 每个命令带着添加定时器时的 tag（连接的代数），执行时 tag 对不上就说明 fd 已经换了连接，直接丢弃，
+ *   不会把旧连接的取消/延期作用到新连接上；
+ * - 延期和取消只会让定时器变晚或消失，所以不需要唤醒正在 epoll_wait 的事件循环：
+ *   就算先醒来，也是先执行命令再处理到期的定时器。
+ */
+class LoopTimer {
+public:
+    explicit LoopTimer(size_t queueCapacity = 4096);
+
+    void BindThread();                  // 由事件循环线程在开始循环前调用
+    bool InLoopThread() const;
+
+    // 只能在事件循环线程调用
+    void Add(int id, int timeout, const TimeoutCallback& cb, uint32_t tag);
+    int GetNextTick();                  // 先执行其他线程提交的命令，再处理到期的定时器
+
+    // 任意线程都可以调用
+    void Adjust(int id, uint32_t tag, int timeout);
+    void Cancel(int id, uint32_t tag);
+
+    size_t Size() const { return wheel_.Size(); }
+
+private:
+    struct Command {
+        enum Type { ADJUST, CANCEL };
+        Type type;
+        int id;
+        uint32_t tag;
+        int timeout;
+    };
+
+    void Push_(Command cmd);
+    void Apply_(const Command& cmd);
+    void Drain_();
+
+    TimingWheel wheel_;
+    std::atomic<std::thread::id> owner_;
+
+    MpmcQueue<Command> commands_;
+    std::atomic<bool> hasOverflow_;
+    std::mutex overflowMtx_;
+    std::vector<Command> overflow_;
+};
+
+#endif // LOOP_TIMER_H
@@ -0,0 +1,193 @@
+#include "TimingWheel.h"
+
+#include <algorithm>
+
+#include "CoarseClock.h"
+
+TimingWheel::TimingWheel() : slots_(ROOT_SIZE + (LEVELS - 1) * LEVEL_SIZE, -1),
+        curTick_(NowMs()), count_(0) {}
+
+int64_t TimingWheel::NowMs() {
+    return CoarseClock::NowMs();
+}
+
+void TimingWheel::Add(int id, int timeout, const TimeoutCallback& cb, uint32_t tag) {
+    assert(id >= 0);
+    if (static_cast<size_t>(id) >= nodes_.size()) {
+        nodes_.resize(id + 1);
+    }
+    Node& node = nodes_[id];
+    node.cb = cb;
+    node.tag = tag;
+    node.expires = NowMs() + timeout;
+    if (node.slot >= 0) {
+        if (node.expires >= node.when) return;  // 原来的位置会更早被检查到，到时候再挪
+        Unlink_(id);
+    }
+    else {
+        count_++;
+    }
+    Insert_(id);
+}
+
+// 连接每次有读写都会调用，通常只是往后延，所以只改到期时间
+void TimingWheel::Adjust(int id, int newExpires) {
+    if (id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].slot < 0) return;
+    Node& node = nodes_[id];
+    node.expires = NowMs() + newExpires;
+    if (node.expires < node.when) {
+        Unlink_(id);
+        Insert_(id);
+    }
+}
+
+void TimingWheel::Cancel(int id) {
+    if (id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].slot < 0) return;
+    Unlink_(id);
+    nodes_[id].cb = nullptr;
+    count_--;
+}
+
+void TimingWheel::DoWork(int id) {
+    if (id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].slot < 0) return;
+    Unlink_(id);
+    count_--;
+    TimeoutCallback cb;
+    cb.swap(nodes_[id].cb);
+    cb();       // 触发回调函数，回调里可能重新添加同一个 id
+}
+
+void TimingWheel::Clear() {
+    for (Node& node : nodes_) {
+        node = Node();
+    }
+    for (int& head : slots_) {
+        head = -1;
+    }
+    count_ = 0;
+}
+
+void TimingWheel::Insert_(int id) {
+    Node& node = nodes_[id];
+    int64_t when = node.expires;
+    if (when <= curTick_) {
+        when = curTick_ + 1;            // 已经到期的放到下一刻处理
+    }
+    if (when - curTick_ >= MAX_SPAN) {
+        when = curTick_ + MAX_SPAN - 1; // 超出时间轮范围的先放到最远处，到时候再挪
+    }
+
+    int64_t delta = when - curTick_;
+    int slot;
+    if (delta < ROOT_SIZE) {
+        slot = SlotIndex_(0, when & (ROOT_SIZE - 1));
+    }
+    else {
+        int level = 1;
+        while (delta >= (int64_t(1) << (ROOT_BITS + level * LEVEL_BITS))) {
+            level++;
+        }
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        slot = SlotIndex_(level, (when >> shift) & (LEVEL_SIZE - 1));
+    }
+
+    node.when = when;
+    node.slot = slot;
+    node.prev = -1;
+    node.next = slots_[slot];
+    if (node.next >= 0) {
+        nodes_[node.next].prev = id;
+    }
+    slots_[slot] = id;
+}
+
+void TimingWheel::Unlink_(int id) {
+    Node& node = nodes_[id];
+    assert(node.slot >= 0);
+    if (node.prev >= 0) {
+        nodes_[node.prev].next = node.next;
+    }
+    else {
+        slots_[node.slot] = node.next;
+    }
+    if (node.next >= 0) {
+        nodes_[node.next].prev = node.prev;
+    }
+    node.prev = node.next = node.slot = -1;
+}
+
+void TimingWheel::Cascade_(int level, int index) {
+    int slot = SlotIndex_(level, index);
+    while (slots_[slot] >= 0) {
+        int id = slots_[slot];
+        Unlink_(id);
+        Insert_(id);
+    }
+}
+
+void TimingWheel::Expire_(int index) {
+    int slot = SlotIndex_(0, index);
+    // 每次都从槽头取结点：回调里可能删除或重新添加其他定时器
+    while (slots_[slot] >= 0) {
+        int id = slots_[slot];
+        Unlink_(id);
+        Node& node = nodes_[id];
+        if (node.expires > curTick_) {
+            Insert_(id);        // 中途延后过，还没到真正的到期时间
+            continue;
+        }
+        count_--;
+        TimeoutCallback cb;
+        cb.swap(node.cb);
+        cb();
+    }
+}
+
+void TimingWheel::Advance_(int64_t to) {
+    while (curTick_ < to) {
+        if (count_ == 0) {
+            curTick_ = to;      // 没有定时器，直接跳过去
+            return;
+        }
+        curTick_++;
+        int index = curTick_ & (ROOT_SIZE - 1);
+        if (index == 0) {
+            // 第 0 层转完一圈，依次把上层当前槽的结点分配下来
+            for (int level = 1; level < LEVELS; level++) {
+                int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+                int upper = (curTick_ >> shift) & (LEVEL_SIZE - 1);
+                Cascade_(level, upper);
+                if (upper != 0) break;
+            }
+        }
+        Expire_(index);
+    }
+}
+
+void TimingWheel::Tick() {
+    Advance_(NowMs());
+}
+
+int TimingWheel::GetNextTick() {
+    Tick();
+    if (count_ == 0) return -1;
+    // 第 0 层最近的非空槽
+    for (int64_t i = 1; i < ROOT_SIZE; i++) {
+        if (slots_[SlotIndex_(0, (curTick_ + i) & (ROOT_SIZE - 1))] >= 0) {
+            return static_cast<int>(i);
+        }
+    }
+    // 第 0 层是空的，等到上层最近的非空槽分配下来的时刻
+    int64_t next = curTick_ + MAX_SPAN;
+    for (int level = 1; level < LEVELS; level++) {
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        int64_t base = curTick_ >> shift;
+        for (int d = 1; d <= LEVEL_SIZE; d++) {
+            if (slots_[SlotIndex_(level, (base + d) & (LEVEL_SIZE - 1))] >= 0) {
+                next = std::min(next, (base + d) << shift);
+                break;
+            }
+        }
+    }
+    return static_cast<int>(next - curTick_);
+}
@@ -0,0 +1,78 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <time.h>
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <functional>
+
+#include "HeepTimer.h"      // TimeoutCallback
+
+/*
+ * 分层时间轮，代替 HeapTimer 管理连接超时
+ * - 刻度为 1ms，4 层分别有 256、64、64、64 个槽，可表示约 18.6 小时以内的定时，更远的按最远处理；
+ * - 结点按 id（连接的 fd）存放在数组里，槽内用下标串成双向链表，添加、删除都是 O(1)，不需要哈希表；
+ * - 延后超时（Adjust）只改写结点的到期时间，不移动结点：结点所在的槽到期时发现还没到真正的到期时间，再重新挂到新位置；
+ * - 时间取自 CoarseClock（CLOCK_MONOTONIC_COARSE），事件循环线程上一轮 epoll_wait 只读一次。
+ * 和 HeapTimer 一样不是线程安全的，只能由所属的事件循环线程使用。
+ */
+class TimingWheel {
+public:
+    TimingWheel();
+    ~TimingWheel() { Clear(); }
+
+    // 添加定时器，id 已存在时更新到期时间和回调；tag 由调用者自定义（连接用它记录代数），用来区分同一个 id 前后不同的主人
+    void Add(int id, int timeout, const TimeoutCallback& cb, uint32_t tag = 0);
+    void Adjust(int id, int newExpires);    // 把到期时间改为 newExpires 毫秒之后
+    void Cancel(int id);                    // 删除定时器，不触发回调
+    void DoWork(int id);                    // 立即触发回调并删除
+    void Clear();
+    void Tick();                            // 处理所有已经到期的定时器
+    int GetNextTick();                      // 处理到期的定时器，返回距离下一次需要检查的毫秒数，没有定时器时返回 -1
+
+    size_t Size() const { return count_; }
+
+    // id 上是否有定时器，且是由 tag 添加的
+    bool Contains(int id, uint32_t tag) const {
+        return id >= 0 && static_cast<size_t>(id) < nodes_.size()
+            && nodes_[id].slot >= 0 && nodes_[id].tag == tag;
+    }
+
+    static int64_t NowMs();
+
+private:
+    static const int LEVELS = 4;
+    static const int ROOT_BITS = 8;         // 第 0 层 256 个槽
+    static const int LEVEL_BITS = 6;        // 其余每层 64 个槽
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int64_t MAX_SPAN = int64_t(1) << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS);
+
+    struct Node {
+        int prev = -1;
+        int next = -1;
+        int slot = -1;          // 所在槽在 slots_ 中的下标，-1 表示不在时间轮中
+        uint32_t tag = 0;
+        int64_t expires = 0;    // 真正的到期时间
+        int64_t when = 0;       // 挂入槽时依据的时间，结点最晚在这个时间被检查
+        TimeoutCallback cb;
+    };
+
+    void Insert_(int id);       // 按 expires 挂到对应的槽
+    void Unlink_(int id);
+    void Cascade_(int level, int index);    // 把上层一个槽的结点重新分配到下层
+    void Advance_(int64_t to);  // 时间轮逐刻前进到 to
+    void Expire_(int index);    // 处理第 0 层的一个槽
+
+    static int SlotIndex_(int level, int index) {
+        return level == 0 ? index : ROOT_SIZE + (level - 1) * LEVEL_SIZE + index;
+    }
+
+    std::vector<Node> nodes_;       // 以 id 为下标
+    std::vector<int> slots_;        // 每个槽链表的头结点 id，-1 表示空
+    int64_t curTick_;               // 已经处理到的时刻
+    size_t count_;
+};
+
+#endif // TIMING_WHEEL_H